@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sge_proto.h"
+#include "sge_pack.h"
+
+#define DATA_SIZE (1 << 20)
+#define ROUNDS 200
+
+// the byte at a time loops sge_pack and sge_unpack used before the SIMD kernels, the unpack loop no longer
+// reads the mask byte after the input
+static int
+loop_pack(const char* in_str, int len, char* out_str) {
+	int move_step = 0;
+	char* mask = out_str;
+	char* p_out = out_str + 1;
+	const char* p_in = in_str;
+
+	while(len-- > 0) {
+		if (move_step == 8) {
+			move_step = 0;
+			mask = p_out;
+			p_out++;
+		}
+		if (*p_in) {
+			*p_out = *p_in;
+			*mask |= (1 << move_step);
+			p_out++;
+		}
+		p_in++;
+		move_step++;
+	}
+	return p_out - out_str;
+}
+
+static int
+loop_unpack(const char* in_str, int len, char* out_str) {
+	int move_step = 0;
+	char mask = *in_str;
+	const char* p_in = in_str + 1;
+	char* p_out = out_str;
+
+	len--;
+	while(len > 0) {
+		if (mask & (0x01 << move_step)) {
+			*p_out = *p_in;
+			len--;
+			p_in++;
+		} else {
+			*p_out = 0x00;
+		}
+		move_step++;
+		p_out++;
+		if (move_step == 8) {
+			move_step = 0;
+			mask = len > 0 ? *p_in : 0;
+			len--;
+			p_in++;
+		}
+	}
+	return p_out - out_str;
+}
+
+static double
+now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+fill(char* data, int len, int percent) {
+	int i;
+	for (i = 0; i < len; ++i) {
+		data[i] = (rand() % 100 < percent) ? (char)(1 + rand() % 255) : 0;
+	}
+}
+
+// the packed and unpacked bytes of every length up to 300 must match the old loops
+static int
+check(char* data, char* a, char* b, char* c, char* d) {
+	int len, percent, la, lb;
+
+	for (percent = 0; percent <= 100; percent += 10) {
+		for (len = 1; len <= 300; ++len) {
+			fill(data, len, percent);
+			memset(a, 0, len * 2 + 16);
+			memset(b, 0, len * 2 + 16);
+			la = loop_pack(data, len, a);
+			lb = sge_pack(data, len, b);
+			if (la != lb || memcmp(a, b, la)) {
+				printf("pack differs, len %d, %d%% non zero\n", len, percent);
+				return 1;
+			}
+			memset(c, 0, len * 8 + 16);
+			memset(d, 0, len * 8 + 16);
+			la = loop_unpack(a, lb, c);
+			lb = sge_unpack(b, lb, d);
+			if (la != lb || la > len || memcmp(c, d, la) || memcmp(d, data, len)) {
+				printf("unpack differs, len %d, %d%% non zero\n", len, percent);
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char const *argv[]) {
+	int i, percent, packed = 0;
+	double t, loop_p, loop_u, simd_p, simd_u;
+	char* data = malloc(DATA_SIZE);
+	char* out = malloc(DATA_SIZE + DATA_SIZE / 8 + 1);
+	char* back = malloc(DATA_SIZE * 8);
+	char* spare = malloc(DATA_SIZE * 8);
+
+	srand(1);
+	if (check(data, out, spare, back, spare + DATA_SIZE * 4)) {
+		return 1;
+	}
+	printf("kernel: %s\n", sge_pack_kernel());
+	printf("non zero | pack loop | pack kernel | unpack loop | unpack kernel (GB/s of unpacked bytes)\n");
+
+	for (percent = 10; percent <= 90; percent += 20) {
+		fill(data, DATA_SIZE, percent);
+
+		memset(out, 0, DATA_SIZE + DATA_SIZE / 8 + 1);
+		t = now();
+		for (i = 0; i < ROUNDS; ++i) {
+			packed = loop_pack(data, DATA_SIZE, out);
+		}
+		loop_p = now() - t;
+
+		t = now();
+		for (i = 0; i < ROUNDS; ++i) {
+			sge_pack(data, DATA_SIZE, out);
+		}
+		simd_p = now() - t;
+
+		t = now();
+		for (i = 0; i < ROUNDS; ++i) {
+			loop_unpack(out, packed, back);
+		}
+		loop_u = now() - t;
+
+		t = now();
+		for (i = 0; i < ROUNDS; ++i) {
+			sge_unpack(out, packed, back);
+		}
+		simd_u = now() - t;
+
+		printf("%7d%% | %9.2f | %11.2f | %11.2f | %13.2f\n", percent,
+			ROUNDS * (double)DATA_SIZE / loop_p / 1e9, ROUNDS * (double)DATA_SIZE / simd_p / 1e9,
+			ROUNDS * (double)DATA_SIZE / loop_u / 1e9, ROUNDS * (double)DATA_SIZE / simd_u / 1e9);
+	}
+
+	free(data);
+	free(out);
+	free(back);
+	free(spare);
+	return 0;
+}
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sge_proto.h"
+
+// a batch entry whose string claims more bytes than the entry has is rejected before any of them reach a callback
+
+typedef struct entry {
+	long id;
+	const char* name;
+} entry;
+
+static const char* SCHEMA = "		\
+Entry 1 {							\
+	id: number;						\
+	name: string;					\
+}									\
+";
+
+static const uint8_t* g_start;		// the entry being decoded
+static const uint8_t* g_end;
+static int g_outside;
+
+static void
+get_field(const void* ud, sge_value* sv) {
+	const entry* e = ud;
+
+	if (strcmp(sv->name, "id") == 0) {
+		*(long*)sv->ptr = e->id;
+	} else {
+		sv->ptr = e->name;
+		sv->len = strlen(e->name);
+	}
+}
+
+static void*
+set_field(void* ud, sge_value* sv) {
+	const uint8_t* p = sv->ptr;
+
+	if (sv->vt == SGE_STRING && (p < g_start || p + sv->len > g_end)) {
+		g_outside++;
+	}
+	return NULL;
+}
+
+// decodes every entry, 1 when all of them are, 0 at the first one rejected
+static int
+decode_all(const char* buffer, size_t len) {
+	sge_batch_iter it;
+	long size;
+	int ret, n = 1;
+
+	if (sge_decode_batch(buffer, len, &it) < 0) {
+		return 0;
+	}
+	do {
+		if (it.end - it.cur >= 6) {
+			g_start = (const uint8_t*)it.cur + 6;
+			size = ((long)(uint8_t)it.cur[2] << 24) | ((uint8_t)it.cur[3] << 16) | ((uint8_t)it.cur[4] << 8) |
+				(uint8_t)it.cur[5];
+			g_end = g_start + size;
+		}
+		ret = sge_batch_next(&it, &n, set_field, NULL);
+	} while (ret == 1);
+	return ret == 0;
+}
+
+// the length of the first entry's name set to value
+static void
+set_name_length(char* buffer, int version, size_t value) {
+	uint8_t* p = (uint8_t*)buffer + SGE_BATCH_HEADER_SIZE + 6 + (version == SGE_VERSION_2 ? 1 : 4);
+
+	switch (version) {
+		case SGE_VERSION_2:
+			p[0] = value < 0x7f ? (uint8_t)value : 0x7f;
+			break;
+		case SGE_VERSION_3:
+			p[0] = (value >> 24) & 0xff;
+			p[1] = (value >> 16) & 0xff;
+			p[2] = (value >> 8) & 0xff;
+			p[3] = value & 0xff;
+			break;
+		default:
+			p[0] = (value >> 8) & 0xff;
+			p[1] = value & 0xff;
+			break;
+	}
+}
+
+int main(int argc, char const *argv[]) {
+	entry entries[2] = {{1, "first"}, {2, "second"}};
+	sge_batch_item items[2] = {{"Entry", entries}, {"Entry", entries + 1}};
+	int version, ok = 1, len, ret, i;
+	size_t past[2];
+	char* buffer;
+
+	ret = sge_parse(SCHEMA);
+	if (ret != SGE_OK) {
+		printf("parse error: %s\n", sge_error(ret));
+		return 1;
+	}
+	sge_set_option(SGE_OPT_INTEGRITY, SGE_INTEGRITY_NONE);
+
+	for (version = SGE_VERSION_1; version <= SGE_VERSION_3; ++version) {
+		sge_set_option(SGE_OPT_VERSION, version);
+		len = sge_encode_batch(items, 2, NULL, 0, get_field);
+		// exactly the container, so a read past it is a read past the allocation
+		buffer = malloc(len);
+		g_outside = 0;
+		if (len != sge_encode_batch(items, 2, buffer, len, get_field) || !decode_all(buffer, len) || g_outside) {
+			printf("version %d: intact batch failed\n", version);
+			ok = 0;
+		}
+
+		// into the second entry, then past the end of the container
+		past[0] = strlen(entries[0].name) + 4;
+		past[1] = 0x7fffffff;
+		for (i = 0; i < 2; ++i) {
+			set_name_length(buffer, version, past[i]);
+			g_outside = 0;
+			if (decode_all(buffer, len) || g_outside) {
+				printf("version %d: name length %zu accepted, %d strings outside the entry\n", version, past[i],
+					g_outside);
+				ok = 0;
+			}
+		}
+		free(buffer);
+	}
+
+	sge_destroy(1);
+	printf("%s\n", ok ? "ok" : "failed");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sge_proto.h"
+
+// strings and lists past 65535 round trip through version 2 and 3 frames and make version 1 fail
+#define WIDE_SIZE	100000
+#define WIDE_ITEMS	70000
+
+typedef struct wide_string {
+	const char* ptr;
+	size_t len;
+} wide_string;
+
+typedef struct blob {
+	wide_string s;
+	const int8_t* l;
+	size_t l_len;
+	const wide_string* ss;
+	size_t ss_len;
+} blob;
+
+typedef struct dump {
+	long id;
+	const blob* blobs;
+	size_t blobs_len;
+} dump;
+
+static const char* SCHEMA = "		\
+Blob 1 {							\
+	s: string;						\
+	l: number8[];					\
+	ss: string[];					\
+}									\
+Dump 2 {							\
+	id: number;						\
+	blobs: Blob[];					\
+}									\
+";
+
+static size_t g_checked;
+static int g_bad;
+
+static void
+get_field(const void* ud, sge_value* sv) {
+	const dump* d = ud;
+	const blob* b = ud;
+
+	if (sv->idx >= 0) {
+		if (strcmp(sv->name, "l") == 0) {
+			*(long*)sv->ptr = ((const int8_t*)ud)[sv->idx];
+		} else if (strcmp(sv->name, "ss") == 0) {
+			sv->ptr = ((const wide_string*)ud)[sv->idx].ptr;
+			sv->len = ((const wide_string*)ud)[sv->idx].len;
+		} else {
+			sv->ptr = (const blob*)ud + sv->idx;
+		}
+		return;
+	}
+
+	if (strcmp(sv->name, "id") == 0) {
+		*(long*)sv->ptr = d->id;
+	} else if (strcmp(sv->name, "blobs") == 0) {
+		sv->ptr = d->blobs;
+		sv->len = d->blobs_len;
+	} else if (strcmp(sv->name, "s") == 0) {
+		sv->ptr = b->s.ptr;
+		sv->len = b->s.len;
+	} else if (strcmp(sv->name, "l") == 0) {
+		sv->ptr = b->l;
+		sv->len = b->l_len;
+	} else {
+		sv->ptr = b->ss;
+		sv->len = b->ss_len;
+	}
+}
+
+static void
+check(int ok) {
+	g_checked++;
+	if (!ok) {
+		g_bad++;
+	}
+}
+
+static int
+same(const wide_string* want, const sge_value* sv) {
+	return want->len == sv->len && memcmp(want->ptr, sv->ptr, sv->len) == 0;
+}
+
+// compares what is decoded against the message it was encoded from, ud walks the source
+static void*
+set_field(void* ud, sge_value* sv) {
+	const dump* d = ud;
+	const blob* b = ud;
+
+	if (sv->idx >= 0) {
+		if (strcmp(sv->name, "l") == 0) {
+			check(*(const long*)sv->ptr == ((const int8_t*)ud)[sv->idx]);
+		} else if (strcmp(sv->name, "ss") == 0) {
+			check(same((const wide_string*)ud + sv->idx, sv));
+		} else {
+			return (blob*)ud + sv->idx;
+		}
+		return NULL;
+	}
+
+	if (strcmp(sv->name, "id") == 0) {
+		check(*(const long*)sv->ptr == d->id);
+	} else if (strcmp(sv->name, "blobs") == 0) {
+		check(sv->len == d->blobs_len);
+		return (void*)d->blobs;
+	} else if (strcmp(sv->name, "s") == 0) {
+		check(same(&b->s, sv));
+	} else if (strcmp(sv->name, "l") == 0) {
+		check(sv->len == b->l_len);
+		return (void*)b->l;
+	} else {
+		check(sv->len == b->ss_len);
+		return (void*)b->ss;
+	}
+	return NULL;
+}
+
+// every item, string, list length and number compared by set_field
+static size_t
+expected_checks(const dump* d) {
+	size_t i, n = 2;
+
+	for (i = 0; i < d->blobs_len; ++i) {
+		n += 3 + d->blobs[i].l_len + d->blobs[i].ss_len;
+	}
+	return n;
+}
+
+static int
+round_trip(const dump* d, int version) {
+	int size, len, ret;
+	char* buffer;
+
+	sge_set_option(SGE_OPT_VERSION, version);
+	size = sge_encoded_size("Dump", d, get_field);
+	if (size < 0) {
+		printf("version %d: encoded size failed: %s\n", version, sge_error(size));
+		return 0;
+	}
+
+	buffer = malloc(size);
+	len = sge_encode_n("Dump", d, buffer, size, get_field);
+	if (len != size) {
+		printf("version %d: encoded %d bytes, expected %d\n", version, len, size);
+		free(buffer);
+		return 0;
+	}
+
+	g_checked = 0;
+	g_bad = 0;
+	ret = sge_decode(buffer, (void*)d, set_field);
+	free(buffer);
+	if (ret < 0 || g_bad || g_checked != expected_checks(d)) {
+		printf("version %d: decode %d, %d of %zu values differ, %zu expected\n", version, ret, g_bad, g_checked,
+			expected_checks(d));
+		return 0;
+	}
+	printf("version %d: %d byte frame round trips\n", version, len);
+	return 1;
+}
+
+int main(int argc, char const *argv[]) {
+	int i, ok = 1, ret;
+	char* text = malloc(WIDE_SIZE);
+	int8_t* numbers = malloc(WIDE_ITEMS);
+	wide_string* strings = malloc(sizeof(wide_string) * WIDE_ITEMS);
+	blob* blobs = calloc(WIDE_ITEMS, sizeof(blob));
+	dump d;
+
+	for (i = 0; i < WIDE_SIZE; ++i) {
+		text[i] = 'a' + i % 26;
+	}
+	for (i = 0; i < WIDE_ITEMS; ++i) {
+		numbers[i] = (int8_t)(i * 7);
+		strings[i].ptr = text + i % 26;
+		strings[i].len = 1 + i % 3;
+	}
+
+	// one blob with a long string and long lists, the rest make the blob list long
+	blobs[0].s.ptr = text;
+	blobs[0].s.len = WIDE_SIZE;
+	blobs[0].l = numbers;
+	blobs[0].l_len = WIDE_ITEMS;
+	blobs[0].ss = strings;
+	blobs[0].ss_len = WIDE_ITEMS;
+	for (i = 1; i < WIDE_ITEMS; ++i) {
+		blobs[i].s = strings[i];
+		blobs[i].l = numbers + i;
+		blobs[i].l_len = 1;
+		blobs[i].ss = strings + i;
+		blobs[i].ss_len = 1;
+	}
+	d.id = 123456789;
+	d.blobs = blobs;
+	d.blobs_len = WIDE_ITEMS;
+
+	ret = sge_parse(SCHEMA);
+	if (ret != SGE_OK) {
+		printf("parse error: %s\n", sge_error(ret));
+		return 1;
+	}
+
+	ok &= round_trip(&d, SGE_VERSION_2);
+	ok &= round_trip(&d, SGE_VERSION_3);
+
+	sge_set_option(SGE_OPT_VERSION, SGE_VERSION_1);
+	ret = sge_encoded_size("Dump", &d, get_field);
+	if (ret != LENGTH_OVERFLOW) {
+		printf("version 1: encoded size %d, expected LENGTH_OVERFLOW\n", ret);
+		ok = 0;
+	}
+
+	sge_destroy(1);
+	free(blobs);
+	free(strings);
+	free(numbers);
+	free(text);
+	printf("%s\n", ok ? "ok" : "failed");
+	return ok ? 0 : 1;
+}
@@ -36,4 +36,8 @@ const result1 = sgeProto.decode(unpack_code1)
 console.log(result1[0])
 console.log(result1[1])
 
+const out = Buffer.alloc(256);
+const size = sgeProto.encodeInto("Person", data, out, 16);
+console.log(sgeProto.decode(out.subarray(16, 16 + size))[1])
+
 sgeProto.destroy();
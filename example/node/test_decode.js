@@ -0,0 +1,48 @@
+// a frame whose lengths point past the bytes given is rejected, without reading past them
+const assert = require('assert');
+const sgeProto = require('../../src/node/build/Release/sgeProto.node');
+
+sgeProto.parse('Item 1 { id: number; name: string; tags: string[]; }');
+const item = { id: 7, name: 'name', tags: ['a', 'bb'] };
+const pending = [];
+const widths = { [sgeProto.VERSION_1]: 2, [sgeProto.VERSION_2]: 1, [sgeProto.VERSION_3]: 4 };
+
+for (const version of [sgeProto.VERSION_1, sgeProto.VERSION_2, sgeProto.VERSION_3]) {
+	sgeProto.setOption(sgeProto.OPT_VERSION, version);
+	for (const integrity of [sgeProto.INTEGRITY_NONE, sgeProto.INTEGRITY_CRC32C]) {
+		sgeProto.setOption(sgeProto.OPT_INTEGRITY, integrity);
+		const code = Buffer.from(sgeProto.encode('Item', item));
+		assert.deepStrictEqual(sgeProto.decode(code)[1], item);
+		const padded = Buffer.concat([Buffer.from('xx'), code, Buffer.from('yy')]);
+		assert.deepStrictEqual(sgeProto.decode(padded.subarray(2, 2 + code.length))[1], item);
+		// a frame that ends in zero bytes, up to a whole group of them, decodes after pack and unpack
+		for (const tags of [[], ['a', 'a', 'a']]) {
+			const frame = sgeProto.encode('Item', { id: 0, name: '', tags });
+			const unpacked = sgeProto.unpack(sgeProto.pack(frame));
+			assert.deepStrictEqual(sgeProto.decode(unpacked), sgeProto.decode(frame));
+			pending.push(sgeProto.unpackAsync(sgeProto.pack(frame)).then((u) => assert.deepStrictEqual(sgeProto.decode(u),
+				sgeProto.decode(unpacked))));
+		}
+
+		// every cut of the frame, the length of the name grown by one and then past any buffer
+		const frames = [];
+		for (let n = 6; n < code.length; ++n) {
+			frames.push(Buffer.from(code.subarray(0, n)));
+		}
+		const at = 6 + (version === sgeProto.VERSION_2 ? 1 : 4);
+		const width = widths[version];
+		for (const value of [item.name.length + 1, width === 1 ? 0x7f : 2 ** (8 * width) - 1]) {
+			const frame = Buffer.from(code);
+			frame.writeUIntBE(value, at, width);
+			frames.push(frame);
+		}
+		for (const frame of frames) {
+			assert.throws(() => sgeProto.decode(frame), `version ${version}: ${frame.toString('hex')} decoded`);
+		}
+	}
+}
+
+Promise.all(pending).then(() => {
+	sgeProto.destroy();
+	console.log('ok');
+});
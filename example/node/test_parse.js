@@ -0,0 +1,19 @@
+// a failed parse clears the schema; the keys bound before it are released and the next parse binds its own
+const assert = require('assert');
+const sgeProto = require('../../src/node/build/Release/sgeProto.node');
+
+const schema = (fields) => `Item 1 { ${fields.map((f) => `${f}: string;`).join(' ')} }`;
+
+for (let i = 0; i < 1000; ++i) {
+	const fields = [`a${i}`, `b${i % 7}`, 'c'];
+	sgeProto.parse(schema(fields));
+	assert.throws(() => sgeProto.parse('Bad 2 { b: Nope; }'));
+	sgeProto.parse(schema(fields));
+
+	const item = Object.fromEntries(fields.map((f, j) => [f, `${f}=${j}`]));
+	assert.deepStrictEqual(sgeProto.decode(sgeProto.encode('Item', item))[1], item);
+	assert.throws(() => sgeProto.parse('Bad 2 { b: Nope; }'));
+}
+
+sgeProto.destroy();
+console.log('ok');
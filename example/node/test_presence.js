@@ -0,0 +1,46 @@
+// strings of one block round trip through presence bitmap frames, which read every field of a block before writing it
+const assert = require('assert');
+const sgeProto = require('../../src/node/build/Release/sgeProto.node');
+
+sgeProto.parse(`
+Tag 1 {
+	key: string;
+	value: string;
+}
+Item 2 {
+	a: string;
+	b: string;
+	n: number;
+	tags: string[];
+	tag: Tag;
+	more: Tag[];
+}
+`);
+sgeProto.setOption(sgeProto.OPT_PRESENCE, sgeProto.PRESENCE_BITMAP);
+
+const item = {
+	a: 'first',
+	b: 'second!',
+	n: 7,
+	tags: ['x', 'yy', 'zzz'],
+	tag: { key: 'héllo', value: '✓ 😀' },
+	more: [{ key: 'k1', value: 'v1' }, { key: 'k2', value: 'v'.repeat(40000) }],
+};
+
+for (const version of [sgeProto.VERSION_1, sgeProto.VERSION_2, sgeProto.VERSION_3]) {
+	sgeProto.setOption(sgeProto.OPT_VERSION, version);
+	const code = sgeProto.encode('Item', item);
+	assert.deepStrictEqual(sgeProto.decode(code)[1], item);
+
+	const out = Buffer.alloc(code.length);
+	assert.strictEqual(sgeProto.encodeInto('Item', item, out), code.length);
+	assert.deepStrictEqual(sgeProto.decode(out)[1], item);
+
+	const other = { a: 'third', b: 'fourth', tag: { key: 'a', value: 'b' } };
+	const frames = sgeProto.decodeBatch(sgeProto.encodeBatch([['Item', item], ['Item', other]]));
+	assert.deepStrictEqual(frames[0][1], item);
+	assert.deepStrictEqual(frames[1][1], Object.assign({ n: 0, tags: [], more: [] }, other));
+	console.log('version', version, 'ok');
+}
+
+sgeProto.destroy();
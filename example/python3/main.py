@@ -20,6 +20,10 @@ pack_code = sgeProto.pack(code)
 unpack_code = sgeProto.unpack(pack_code)
 result = sgeProto.decode(unpack_code)
 
+# the same four steps for many messages in two calls
+frames = sgeProto.encodeMany('Person', [data] * 100, True)
+results = sgeProto.decodeMany(frames, True)
+
 for i in range(10000000):
 	code = sgeProto.encode('Person', data)
 	pack_code = sgeProto.pack(code)
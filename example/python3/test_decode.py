@@ -0,0 +1,38 @@
+# a frame whose lengths point past the bytes given is rejected by every decode, without reading past them
+import sgeProto
+
+sgeProto.parse('Item 1 { id: number; name: string; tags: string[]; }')
+item = {'id': 7, 'name': 'name', 'tags': ['a', 'bb']}
+
+for version in (sgeProto.VERSION_1, sgeProto.VERSION_2, sgeProto.VERSION_3):
+	sgeProto.setOption(sgeProto.OPT_VERSION, version)
+	for integrity in (sgeProto.INTEGRITY_NONE, sgeProto.INTEGRITY_CRC32C):
+		sgeProto.setOption(sgeProto.OPT_INTEGRITY, integrity)
+		code = sgeProto.encode('Item', item)
+		assert sgeProto.decode(code)[1] == item
+		assert sgeProto.decode(bytearray(b'xx' + code + b'yy'), 2, len(code))[1] == item
+		assert sgeProto.decodeMany([code, memoryview(code)]) == [(1, item)] * 2
+		# a frame that ends in zero bytes, up to a whole group of them, decodes after pack and unpack
+		for tags in ([], ['a'] * 3):
+			frame = sgeProto.encode('Item', {'id': 0, 'name': '', 'tags': tags})
+			assert sgeProto.decode(sgeProto.unpack(sgeProto.pack(frame))) == sgeProto.decode(frame)
+		batch = sgeProto.encodeBatch([('Item', item)])
+		assert sgeProto.decodeBatch(bytearray(batch)) == sgeProto.decodeBatch(memoryview(batch)) == [(1, item)]
+
+		# every cut of the frame, the length of the name grown by one and then past any buffer
+		frames = [code[:n] for n in range(6, len(code))]
+		at = 6 + (1 if version == sgeProto.VERSION_2 else 4)
+		width = {sgeProto.VERSION_1: 2, sgeProto.VERSION_2: 1, sgeProto.VERSION_3: 4}[version]
+		for value in (len(item['name']) + 1, 0x7f if width == 1 else (1 << 8 * width) - 1):
+			frames.append(code[:at] + value.to_bytes(width, 'big') + code[at + width:])
+		for frame in frames:
+			for decode in (sgeProto.decode, sgeProto.decodeObject, lambda f: sgeProto.decodeMany([f])):
+				try:
+					decode(frame)
+				except RuntimeError:
+					pass
+				else:
+					raise AssertionError('version %d: %r decoded' % (version, frame))
+
+sgeProto.destory()
+print('ok')
@@ -0,0 +1,47 @@
+# a failed parse clears the schema; the fields bound by the parses before it must be released, not leaked
+import gc
+import tracemalloc
+import sgeProto
+
+SCHEMA = 'Tag 1 { key: string; value: string; } Item 2 { ' + ' '.join('f%d: number;' % i for i in range(30)) + ' tag: Tag; }'
+item = dict(('f%d' % i, i) for i in range(30))
+item['tag'] = {'key': 'k', 'value': 'v'}
+
+
+def cycle():
+	sgeProto.parse(SCHEMA)
+	try:
+		sgeProto.parse('Bad 3 { b: Nope; }')
+	except RuntimeError:
+		pass
+	else:
+		raise AssertionError('the bad schema parsed')
+
+
+tracemalloc.start()
+for i in range(2000):
+	cycle()
+gc.collect()
+before = tracemalloc.get_traced_memory()[0]
+for i in range(2000):
+	cycle()
+gc.collect()
+grown = tracemalloc.get_traced_memory()[0] - before
+tracemalloc.stop()
+assert grown < 64 * 1024, 'parse then failed parse kept %d bytes' % grown
+
+# the classes go with the schema, a block parsed again gets one with its new fields
+sgeProto.parse('X 1 { a: number; }')
+cycle()
+sgeProto.parse('X 1 { b: string; c: string; }')
+assert sgeProto.classes()['X'].__slots__ == ['b', 'c']
+x = sgeProto.decodeObject(sgeProto.encode('X', {'b': 'bb', 'c': 'cc'}))[1]
+assert (x.b, x.c) == ('bb', 'cc')
+assert sgeProto.decode(sgeProto.encode('X', x))[1] == {'b': 'bb', 'c': 'cc'}
+cycle()
+
+sgeProto.parse(SCHEMA)
+assert sgeProto.decode(sgeProto.encode('Item', item))[1] == item
+assert sgeProto.decodeObject(sgeProto.encode('Item', item))[1].tag.key == 'k'
+sgeProto.destory()
+print('ok')
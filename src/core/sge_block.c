@@ -1,6 +1,10 @@
 #include <string.h>
 #include "sge_block.h"
 
+#define BOUND_UNKNOWN	0
+#define BOUND_PENDING	1
+#define BOUND_DONE		2
+
 sge_block*
 sge_alloc_block(const char* block_name, size_t name_len, uint32_t idx) {
 	size_t size = sizeof(sge_block) + name_len + 1;
@@ -9,6 +13,10 @@ sge_alloc_block(const char* block_name, size_t name_len, uint32_t idx) {
 	LIST_INIT(&(block->head));
 	LIST_INIT(&(block->field_head));
 	block->size = 0;
+	block->codes = NULL;
+	block->bound_state = BOUND_UNKNOWN;
+	block->fixed_bound = block->varint_bound = SGE_UNBOUNDED;
+	block->bitmap_bound = 0;
 	strncpy(block->name, block_name, name_len);
 	block->name[name_len] = '\0';
 	return block;
@@ -27,6 +35,119 @@ sge_destroy_block(sge_block* block) {
 		p = next;
 	}
 
+	if (block->codes) {
+		sge_free(block->codes);
+	}
 	LIST_REMOVE(&block->head);
 	sge_free(block);
 }
+
+static uint32_t
+hash_name(const char* name, size_t len) {
+	uint32_t hash = 5381;
+	size_t i = 0;
+
+	for (; i < len; ++i) {
+		hash = ((hash << 5) + hash) + name[i];
+	}
+	return hash;
+}
+
+int
+sge_compile_block(sge_block* block) {
+	sge_list* pf;
+	sge_field* field;
+	sge_field_code* code;
+	uint32_t ordinal = 0;
+
+	if (block->codes) {
+		return SGE_OK;
+	}
+
+	code = sge_malloc(sizeof(sge_field_code) * block->size);
+	if (NULL == code) {
+		return SGE_ERR;
+	}
+	block->codes = code;
+	LIST_FOREACH(pf, &block->field_head) {
+		field = LIST_DATA(pf, sge_field, head);
+		code->opcode = field->type->opcode;
+		code->width = field->type->width;
+		code->name_len = field->name_len;
+		code->hash = hash_name(field->name, field->name_len);
+		code->block = field->block;
+		code->name = field->name;
+		code->ordinal = ordinal++;
+		code->slot = NULL;
+		code++;
+	}
+
+	return SGE_OK;
+}
+
+static size_t
+add_bound(size_t bound, size_t n) {
+	if (bound == SGE_UNBOUNDED || n == SGE_UNBOUNDED) {
+		return SGE_UNBOUNDED;
+	}
+	return bound + n;
+}
+
+// needs the codes of every block, a block reachable from itself is unbounded
+int
+sge_bound_block(sge_block* block) {
+	const sge_field_code *code, *end;
+	sge_block *child;
+	size_t fixed = 0, varint = 0, bitmap = (block->size + 7) / 8;
+
+	if (block->bound_state == BOUND_DONE) {
+		return SGE_OK;
+	}
+	if (block->bound_state == BOUND_PENDING || NULL == block->codes) {
+		return SGE_ERR;
+	}
+
+	block->bound_state = BOUND_PENDING;
+	end = block->codes + block->size;
+	for (code = block->codes; code < end; ++code) {
+		switch (code->opcode) {
+			case SGE_OP_NUMBER:
+				fixed = add_bound(fixed, code->width);
+				varint = add_bound(varint, (code->width * 8 + 6) / 7);
+				break;
+			case SGE_OP_CUSTOM:
+				child = (sge_block*)code->block;
+				if (SGE_OK != sge_bound_block(child)) {
+					fixed = varint = SGE_UNBOUNDED;
+					break;
+				}
+				fixed = add_bound(fixed, add_bound(1, child->fixed_bound));
+				varint = add_bound(varint, add_bound(1, child->varint_bound));
+				bitmap += child->bitmap_bound;
+				break;
+			default:
+				fixed = varint = SGE_UNBOUNDED;
+				break;
+		}
+	}
+
+	block->fixed_bound = fixed;
+	block->varint_bound = varint;
+	block->bitmap_bound = bitmap;
+	block->bound_state = BOUND_DONE;
+	return SGE_OK;
+}
+
+const sge_field_code*
+sge_block_code(const sge_block* block, const char* name, size_t name_len) {
+	const sge_field_code *code, *end;
+	uint32_t hash = hash_name(name, name_len);
+
+	end = block->codes + block->size;
+	for (code = block->codes; code < end; ++code) {
+		if (code->hash == hash && code->name_len == name_len && 0 == memcmp(code->name, name, name_len)) {
+			return code;
+		}
+	}
+	return NULL;
+}
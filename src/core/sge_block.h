@@ -3,15 +3,27 @@
 
 #include "sge_field.h"
 
+struct sge_context;
+
 struct sge_block {
 	sge_list head;
+	const struct sge_context* ctx;	// owner, set when the protocol is compiled
 	uint32_t idx;
 	uint32_t size;
 	sge_list field_head;
+	sge_field_code* codes;
+	int bound_state;
+	size_t fixed_bound;		// body size limit in version 1 and 3, SGE_UNBOUNDED with strings or lists
+	size_t varint_bound;	// the same for version 2
+	size_t bitmap_bound;	// presence bitmap bytes of the block and its custom fields, on top of either
 	char name[0];
 };
 
 sge_block* sge_alloc_block(const char* block_name, size_t name_len, uint32_t idx);
 void sge_destroy_block(sge_block* block);
+int sge_compile_block(sge_block* block);
+int sge_bound_block(sge_block* block);
+// the code of the field called name, NULL when the block has none
+const sge_field_code* sge_block_code(const sge_block* block, const char* name, size_t name_len);
 
 #endif
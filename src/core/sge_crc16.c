@@ -1,23 +1,52 @@
 #include "sge_crc16.h"
 
-static const int POLYNOMIAL = 0x1021;
+#define CRC16_POLYNOMIAL 0x1021
+
+static uint16_t crc16_table[8][256];
+
+__attribute__((constructor)) static void
+init_crc16_table() {
+	int i, j;
+	uint16_t crc;
+
+	for (i = 0; i < 256; ++i) {
+		crc = i << 8;
+		for (j = 0; j < 8; ++j) {
+			crc = (crc & 0x8000) ? (crc << 1) ^ CRC16_POLYNOMIAL : (crc << 1);
+		}
+		crc16_table[0][i] = crc;
+	}
+
+	for (i = 0; i < 256; ++i) {
+		crc = crc16_table[0][i];
+		for (j = 1; j < 8; ++j) {
+			crc = (crc << 8) ^ crc16_table[0][crc >> 8];
+			crc16_table[j][i] = crc;
+		}
+	}
+}
+
+// CRC-16/XMODEM, slicing-by-8
+uint16_t sge_crc16_update(uint16_t crc, const char* str, size_t len) {
+	const uint8_t* p = (const uint8_t*)str;
+
+	while (len >= 8) {
+		crc ^= (p[0] << 8) | p[1];
+		crc = crc16_table[7][crc >> 8] ^ crc16_table[6][crc & 0xff] ^
+			crc16_table[5][p[2]] ^ crc16_table[4][p[3]] ^
+			crc16_table[3][p[4]] ^ crc16_table[2][p[5]] ^
+			crc16_table[1][p[6]] ^ crc16_table[0][p[7]];
+		p += 8;
+		len -= 8;
+	}
+
+	while (len--) {
+		crc = (crc << 8) ^ crc16_table[0][(crc >> 8) ^ *p++];
+	}
+
+	return crc;
+}
 
 uint16_t sge_crc16(const char* str, size_t len) {
-    unsigned char i, j;
-    unsigned int crc16 = 0;
-    unsigned int val;
-
-    for(i = 0; i < len; i++) {
-        val = str[i] << 8;
-        for(j = 0; j < 8; j++) {
-            if((crc16 ^ val) & 0x8000) {
-                crc16 = (crc16 << 1) ^ POLYNOMIAL;
-            } else {
-                crc16 <<= 1;
-            }
-            val <<= 1;
-        }
-    }
-
-    return crc16;
+	return sge_crc16_update(0, str, len);
 }
@@ -5,5 +5,6 @@
 #include <stdlib.h>
 
 uint16_t sge_crc16(const char* str, size_t len);
+uint16_t sge_crc16_update(uint16_t crc, const char* str, size_t len);
 
 #endif
@@ -0,0 +1,97 @@
+#include <string.h>
+#include "sge_crc32c.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define SGE_CRC32C_SSE42 1
+#endif
+
+#define CRC32C_POLYNOMIAL 0x82F63B78
+
+typedef uint32_t (*crc32c_fn)(uint32_t, const uint8_t*, size_t);
+
+static uint32_t crc32c_table[8][256];
+
+// CRC-32C (Castagnoli), slicing-by-8 software fallback
+static uint32_t
+crc32c_soft(uint32_t crc, const uint8_t* p, size_t len) {
+	uint32_t lo, hi;
+
+	while (len >= 8) {
+		lo = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+		hi = p[4] | (p[5] << 8) | (p[6] << 16) | ((uint32_t)p[7] << 24);
+		crc = crc32c_table[7][lo & 0xff] ^ crc32c_table[6][(lo >> 8) & 0xff] ^
+			crc32c_table[5][(lo >> 16) & 0xff] ^ crc32c_table[4][lo >> 24] ^
+			crc32c_table[3][hi & 0xff] ^ crc32c_table[2][(hi >> 8) & 0xff] ^
+			crc32c_table[1][(hi >> 16) & 0xff] ^ crc32c_table[0][hi >> 24];
+		p += 8;
+		len -= 8;
+	}
+
+	while (len--) {
+		crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *p++) & 0xff];
+	}
+
+	return crc;
+}
+
+#ifdef SGE_CRC32C_SSE42
+__attribute__((target("sse4.2"))) static uint32_t
+crc32c_sse42(uint32_t crc, const uint8_t* p, size_t len) {
+#if defined(__x86_64__)
+	uint64_t crc64 = crc, v;
+
+	while (len >= 8) {
+		memcpy(&v, p, 8);
+		crc64 = _mm_crc32_u64(crc64, v);
+		p += 8;
+		len -= 8;
+	}
+	crc = (uint32_t)crc64;
+#endif
+	while (len--) {
+		crc = _mm_crc32_u8(crc, *p++);
+	}
+
+	return crc;
+}
+#endif
+
+static crc32c_fn crc32c_impl = crc32c_soft;
+
+__attribute__((constructor)) static void
+init_crc32c() {
+	int i, j;
+	uint32_t crc;
+
+	for (i = 0; i < 256; ++i) {
+		crc = i;
+		for (j = 0; j < 8; ++j) {
+			crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLYNOMIAL : (crc >> 1);
+		}
+		crc32c_table[0][i] = crc;
+	}
+
+	for (i = 0; i < 256; ++i) {
+		crc = crc32c_table[0][i];
+		for (j = 1; j < 8; ++j) {
+			crc = (crc >> 8) ^ crc32c_table[0][crc & 0xff];
+			crc32c_table[j][i] = crc;
+		}
+	}
+
+#ifdef SGE_CRC32C_SSE42
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2")) {
+		crc32c_impl = crc32c_sse42;
+	}
+#endif
+}
+
+uint32_t sge_crc32c_update(uint32_t crc, const char* str, size_t len) {
+	return ~crc32c_impl(~crc, (const uint8_t*)str, len);
+}
+
+uint32_t sge_crc32c(const char* str, size_t len) {
+	return sge_crc32c_update(0, str, len);
+}
@@ -0,0 +1,10 @@
+#ifndef SGE_CRC32C_H_
+#define SGE_CRC32C_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+uint32_t sge_crc32c(const char* str, size_t len);
+uint32_t sge_crc32c_update(uint32_t crc, const char* str, size_t len);
+
+#endif
@@ -12,10 +12,14 @@
 #define INVALID_PARAM		-2
 #define RES_CANT_ACCESS		-3
 #define NOT_SCHEME			-4
-#define MAX_ERROR_CODE		4
+#define LENGTH_OVERFLOW		-5
+#define MAX_ERROR_CODE		5
+
+#define SGE_UNBOUNDED	((size_t)-1)
 
 #define sge_malloc	malloc
 #define sge_free	free
+#define sge_realloc	realloc
 
 typedef enum sge_value_type {
 	SGE_NUMBER = 1,
@@ -30,6 +34,8 @@ typedef struct sge_value {
 	size_t len;
 	int32_t idx;
 	sge_value_type vt;
+	void *slot;			// what the binding stored for this field with sge_bind_fields, NULL if nothing
+	int32_t ordinal;	// position of the field in its block
 } sge_value;
 
 typedef void (*field_get)(const void *, sge_value *);
@@ -38,7 +44,22 @@ typedef void* (*field_set)(void *, sge_value *);
 typedef void (*field_get_fn)(const void*, sge_value*);
 typedef void* (*field_set_fn)(void*, sge_value*);
 
-#define NEW_SGE_VALUE	{NULL, NULL, 0, -1, 1}
+// gets the current slot of a field and returns the one to keep; run over every field by sge_bind_fields,
+// after each parse and before the context is shared, new fields start out NULL
+typedef void* (*sge_bind_fn)(void* slot, const char* name, size_t name_len, void* ud);
+
+// chunked output for sge_encode_sink, flush gets every filled buffer and returns SGE_OK to go on
+typedef struct sge_sink sge_sink;
+struct sge_sink {
+	char* buffer;
+	size_t size;
+	int (*flush)(sge_sink* sink, const char* data, size_t len);
+	void* ud;
+};
+
+#define SGE_SINK_MIN_SIZE	16
+
+#define NEW_SGE_VALUE	{NULL, NULL, 0, -1, 1, NULL, -1}
 
 
 #endif
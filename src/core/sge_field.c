@@ -27,7 +27,7 @@ sge_encode_number(uint8_t* buffer, long value, int size) {
 
 	for (i = 0; i < size; ++i) {
 		offset = size - i - 1;
-		*(buffer + i) |= (value >> (offset * 8)) & 0xff;
+		*(buffer + i) = (value >> (offset * 8)) & 0xff;
 	}
 
 	return size;
@@ -53,21 +53,27 @@ sge_decode_number(const uint8_t* buffer, long* value, int size) {
 }
 
 int
-sge_encode_string(uint8_t* buffer, const char* ud, size_t len) {
-	sge_encode_number(buffer, len, 2);
+sge_encode_varint(uint8_t* buffer, uint64_t value) {
+	int i = 0;
 
-	if (ud) {
-		memcpy(buffer + 2, ud, len);
+	while (value >= 0x80) {
+		buffer[i++] = (value & 0x7f) | 0x80;
+		value >>= 7;
 	}
-	return len + 2;
+	buffer[i++] = value;
+	return i;
 }
 
-int sge_decode_string(const uint8_t* buffer, char** ud, size_t *len) {
-	long value;
-	int sz;
+int
+sge_decode_varint(const uint8_t* buffer, uint64_t* value) {
+	int i = 0, shift = 0;
+	uint64_t val = 0;
+
+	do {
+		val |= (uint64_t)(buffer[i] & 0x7f) << shift;
+		shift += 7;
+	} while ((buffer[i++] & 0x80) && shift < 64);
 
-	sz = sge_decode_number(buffer, &value, 2);
-	*ud = (char*)buffer + sz;
-	*len = value;
-	return sz + 2;
+	*value = val;
+	return i;
 }
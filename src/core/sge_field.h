@@ -8,22 +8,37 @@ typedef struct sge_block sge_block;
 typedef struct sge_field sge_field;
 
 
-typedef int (*field_encode)(const sge_field*, const void*, uint8_t*, field_get cb);
-typedef int (*field_decode)(const sge_field*, void*, const uint8_t*, field_set cb);
 typedef void (*field_print)(const sge_field*, int level);
 
-typedef struct {
-	field_encode encode;
-	field_decode decode;
-	field_print print;
-} sge_field_operations;
+typedef enum sge_opcode {
+	SGE_OP_NUMBER = 1,
+	SGE_OP_NUMBER_LIST,
+	SGE_OP_STRING,
+	SGE_OP_STRING_LIST,
+	SGE_OP_CUSTOM,
+	SGE_OP_CUSTOM_LIST
+} sge_opcode;
 
 typedef struct {
 	const char* name;
 	size_t name_len;
-	const sge_field_operations* ops;
+	sge_opcode opcode;
+	uint8_t width;
+	field_print print;
 } sge_field_type;
 
+// compact field descriptor, one per field, stored contiguously in sge_block.codes
+typedef struct sge_field_code {
+	uint8_t opcode;
+	uint8_t width;
+	uint16_t name_len;
+	uint32_t hash;
+	const sge_block* block;
+	const char* name;
+	uint32_t ordinal;
+	void* slot;
+} sge_field_code;
+
 struct sge_field {
 	sge_list head;
 	const sge_field_type* type;
@@ -37,8 +52,11 @@ void destroy_field(sge_field* field);
 
 int sge_encode_number(uint8_t* buffer, long value, int size);
 int sge_decode_number(const uint8_t* buffer, long* value, int size);
-int sge_encode_string(uint8_t* buffer, const char* ud, size_t len);
-int sge_decode_string(const uint8_t* buffer, char** ud, size_t *len);
+int sge_encode_varint(uint8_t* buffer, uint64_t value);
+int sge_decode_varint(const uint8_t* buffer, uint64_t* value);
+
+#define SGE_ZIGZAG(v)	((((uint64_t)(int64_t)(v)) << 1) ^ (uint64_t)((int64_t)(v) >> 63))
+#define SGE_UNZIGZAG(u)	((int64_t)(((uint64_t)(u) >> 1) ^ (~((uint64_t)(u) & 1) + 1)))
 
 
 #endif
@@ -0,0 +1,237 @@
+#include <string.h>
+#include "sge_index.h"
+
+#define MAX_SEED_TRIES	(1 << 16)
+
+typedef struct {
+	sge_block* block;
+	uint64_t hash;
+	uint32_t bucket;
+} index_key;
+
+// FNV-1a 64 over a NUL terminated name, the low half picks the bucket, the high half the slot
+static inline uint64_t
+hash_name(const char* name) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	for (; *name; ++name) {
+		hash ^= (uint8_t)*name;
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static inline uint32_t
+slot_of(uint64_t hash, uint32_t seed, uint32_t mask) {
+	uint32_t x = (uint32_t)(hash >> 32) ^ (seed * 0x9e3779b9U);
+
+	x ^= x >> 16;
+	x *= 0x85ebca6bU;
+	x ^= x >> 13;
+	x *= 0xc2b2ae35U;
+	x ^= x >> 16;
+	return x & mask;
+}
+
+static int
+build_idx(sge_index* index, sge_list* block_head) {
+	sge_list* iter;
+	sge_block* block;
+	uint32_t size = 0;
+
+	LIST_FOREACH(iter, block_head) {
+		block = LIST_DATA(iter, sge_block, head);
+		if (block->idx > SGE_MAX_BLOCK_IDX) {
+			return SGE_ERR;
+		}
+		if (block->idx >= size) {
+			size = block->idx + 1;
+		}
+	}
+
+	index->by_idx = sge_malloc(sizeof(sge_block*) * (size ? size : 1));
+	if (NULL == index->by_idx) {
+		return SGE_ERR;
+	}
+	memset(index->by_idx, 0, sizeof(sge_block*) * (size ? size : 1));
+	index->idx_size = size;
+
+	// the first block declared with an id owns it
+	LIST_FOREACH(iter, block_head) {
+		block = LIST_DATA(iter, sge_block, head);
+		if (NULL == index->by_idx[block->idx]) {
+			index->by_idx[block->idx] = block;
+		}
+	}
+	return SGE_OK;
+}
+
+static int
+compare_key_bucket(const void* a, const void* b) {
+	uint32_t ba = ((const index_key*)a)->bucket;
+	uint32_t bb = ((const index_key*)b)->bucket;
+	return (ba > bb) - (ba < bb);
+}
+
+// place every bucket, biggest first, at the first seed whose slots are all free
+static int
+place_names(sge_index* index, const index_key* keys, const uint32_t* start, const uint32_t* sizes, uint32_t max_size, uint32_t* placed) {
+	uint32_t size, j, b, seed, slot;
+
+	memset(index->by_name, 0, sizeof(sge_block*) * (index->name_mask + 1));
+	for (size = max_size; size > 0; --size)
+	for (b = 0; b < index->buckets; ++b) {
+		if (sizes[b] != size) {
+			continue;
+		}
+		for (seed = 0; seed < MAX_SEED_TRIES; ++seed) {
+			for (j = 0; j < sizes[b]; ++j) {
+				slot = slot_of(keys[start[b] + j].hash, seed, index->name_mask);
+				if (index->by_name[slot]) {
+					break;
+				}
+				index->by_name[slot] = keys[start[b] + j].block;
+				placed[j] = slot;
+			}
+			if (j == sizes[b]) {
+				break;
+			}
+			while (j--) {
+				index->by_name[placed[j]] = NULL;
+			}
+		}
+		if (seed == MAX_SEED_TRIES) {
+			return SGE_ERR;
+		}
+		index->seeds[b] = seed;
+	}
+	return SGE_OK;
+}
+
+static int
+build_name(sge_index* index, sge_list* block_head) {
+	sge_list* iter;
+	sge_block* block;
+	index_key* keys = NULL;
+	uint32_t *start = NULL, *sizes = NULL, *placed = NULL;
+	uint32_t i, j, n = 0, k = 0, slots = 1, max_size = 0;
+	int ret = SGE_ERR;
+
+	LIST_FOREACH(iter, block_head) {
+		n++;
+	}
+
+	// about 2 names per bucket, the big buckets go first while the table is still empty
+	index->buckets = n / 2 + 1;
+	while (slots < n + n / 4 + 1) {
+		slots <<= 1;
+	}
+
+	keys = sge_malloc(sizeof(index_key) * (n + 1));
+	start = sge_malloc(sizeof(uint32_t) * index->buckets);
+	sizes = sge_malloc(sizeof(uint32_t) * index->buckets);
+	index->seeds = sge_malloc(sizeof(uint32_t) * index->buckets);
+	if (NULL == keys || NULL == start || NULL == sizes || NULL == index->seeds) {
+		goto END;
+	}
+
+	LIST_FOREACH(iter, block_head) {
+		block = LIST_DATA(iter, sge_block, head);
+		keys[k].block = block;
+		keys[k].hash = hash_name(block->name);
+		keys[k].bucket = (uint32_t)keys[k].hash % index->buckets;
+		k++;
+	}
+	// stable for equal buckets, so the first block declared with a name stays
+	for (i = 1; i < n; ++i) {
+		index_key key = keys[i];
+		for (j = i; j > 0 && compare_key_bucket(&keys[j - 1], &key) > 0; --j) {
+			keys[j] = keys[j - 1];
+		}
+		keys[j] = key;
+	}
+
+	memset(sizes, 0, sizeof(uint32_t) * index->buckets);
+	for (i = 0; i < n; ++i) {
+		// drop a later block with a name already in the bucket
+		for (j = i; j > 0 && keys[j - 1].bucket == keys[i].bucket; --j) {
+			if (0 == strcmp(keys[j - 1].block->name, keys[i].block->name)) {
+				break;
+			}
+		}
+		if (j > 0 && keys[j - 1].bucket == keys[i].bucket) {
+			keys[i].block = NULL;
+		}
+	}
+	for (i = 0, k = 0; i < n; ++i) {
+		if (keys[i].block) {
+			keys[k++] = keys[i];
+		}
+	}
+	n = k;
+	for (i = 0; i < n; ++i) {
+		if (sizes[keys[i].bucket]++ == 0) {
+			start[keys[i].bucket] = i;
+		}
+	}
+	for (i = 0; i < index->buckets; ++i) {
+		if (sizes[i] > max_size) {
+			max_size = sizes[i];
+		}
+	}
+	placed = sge_malloc(sizeof(uint32_t) * (max_size + 1));
+	if (NULL == placed) {
+		goto END;
+	}
+
+	for (; slots <= (1U << 24); slots <<= 1) {
+		sge_free(index->by_name);
+		index->by_name = sge_malloc(sizeof(sge_block*) * slots);
+		if (NULL == index->by_name) {
+			goto END;
+		}
+		index->name_mask = slots - 1;
+		if (SGE_OK == place_names(index, keys, start, sizes, max_size, placed)) {
+			ret = SGE_OK;
+			break;
+		}
+	}
+
+END:
+	sge_free(keys);
+	sge_free(start);
+	sge_free(sizes);
+	sge_free(placed);
+	return ret;
+}
+
+int
+sge_index_build(sge_index* index, sge_list* block_head) {
+	sge_index_destroy(index);
+	if (SGE_OK != build_idx(index, block_head) || SGE_OK != build_name(index, block_head)) {
+		sge_index_destroy(index);
+		return SGE_ERR;
+	}
+	return SGE_OK;
+}
+
+void
+sge_index_destroy(sge_index* index) {
+	sge_free(index->by_idx);
+	sge_free(index->by_name);
+	sge_free(index->seeds);
+	memset(index, 0, sizeof(sge_index));
+}
+
+sge_block*
+sge_index_name(const sge_index* index, const char* name) {
+	uint64_t hash;
+	sge_block* block;
+
+	if (NULL == index->by_name) {
+		return NULL;
+	}
+	hash = hash_name(name);
+	block = index->by_name[slot_of(hash, index->seeds[(uint32_t)hash % index->buckets], index->name_mask)];
+	return (block && 0 == strcmp(block->name, name)) ? block : NULL;
+}
@@ -0,0 +1,28 @@
+#ifndef SGE_INDEX_H_
+#define SGE_INDEX_H_
+
+#include "sge_block.h"
+
+#define SGE_MAX_BLOCK_IDX	0xffff	// the wire carries 16 bit protocol ids
+
+// runtime block lookup, rebuilt after every parse: a dense array by protocol id
+// and a perfect hash (hash and displace) by name
+typedef struct sge_index {
+	sge_block** by_idx;
+	uint32_t idx_size;
+	sge_block** by_name;
+	uint32_t* seeds;
+	uint32_t name_mask;
+	uint32_t buckets;
+} sge_index;
+
+int sge_index_build(sge_index* index, sge_list* block_head);
+void sge_index_destroy(sge_index* index);
+sge_block* sge_index_name(const sge_index* index, const char* name);
+
+static inline sge_block*
+sge_index_idx(const sge_index* index, uint32_t idx) {
+	return (idx < index->idx_size) ? index->by_idx[idx] : NULL;
+}
+
+#endif
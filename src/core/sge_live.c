@@ -0,0 +1,190 @@
+#include <string.h>
+#include "sge_live.h"
+#include "sge_parser.h"
+
+#define READER_IDLE	0
+
+typedef struct sge_retired {
+	sge_context* ctx;
+	uint64_t epoch;
+	struct sge_retired* next;
+} sge_retired;
+
+// one cache line per reader so entering and leaving don't bounce each other's lines
+typedef struct {
+	uint64_t epoch;
+	int used;
+	char pad[64 - sizeof(uint64_t) - sizeof(int)];
+} sge_reader_slot;
+
+struct sge_live {
+	sge_context* current;
+	uint64_t epoch;
+	sge_retired* retired;
+	sge_reader_slot readers[SGE_LIVE_MAX_READERS];
+};
+
+sge_live*
+sge_live_new(sge_context* ctx) {
+	sge_live* live;
+
+	if (NULL == ctx) {
+		return NULL;
+	}
+
+	live = sge_malloc(sizeof(sge_live));
+	if (NULL == live) {
+		return NULL;
+	}
+	memset(live, 0, sizeof(sge_live));
+	live->current = ctx;
+	live->epoch = READER_IDLE + 1;
+	return live;
+}
+
+// no reader may be inside when the live context is freed
+void
+sge_live_free(sge_live* live) {
+	sge_retired* r, *next;
+
+	if (NULL == live) {
+		return;
+	}
+
+	for (r = live->retired; r; r = next) {
+		next = r->next;
+		sge_ctx_free(r->ctx);
+		sge_free(r);
+	}
+	sge_ctx_free(live->current);
+	sge_free(live);
+}
+
+int
+sge_live_register(sge_live* live) {
+	int i, expect;
+
+	if (NULL == live) {
+		return INVALID_PARAM;
+	}
+
+	for (i = 0; i < SGE_LIVE_MAX_READERS; ++i) {
+		expect = 0;
+		if (__atomic_compare_exchange_n(&live->readers[i].used, &expect, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+			__atomic_store_n(&live->readers[i].epoch, READER_IDLE, __ATOMIC_RELEASE);
+			return i;
+		}
+	}
+	return SGE_ERR;
+}
+
+void
+sge_live_unregister(sge_live* live, int reader) {
+	__atomic_store_n(&live->readers[reader].epoch, READER_IDLE, __ATOMIC_RELEASE);
+	__atomic_store_n(&live->readers[reader].used, 0, __ATOMIC_RELEASE);
+}
+
+// the returned context stays valid until sge_live_leave, whatever is published meanwhile
+const sge_context*
+sge_live_enter(sge_live* live, int reader) {
+	uint64_t epoch = __atomic_load_n(&live->epoch, __ATOMIC_SEQ_CST);
+
+	__atomic_store_n(&live->readers[reader].epoch, epoch, __ATOMIC_SEQ_CST);
+	return __atomic_load_n(&live->current, __ATOMIC_SEQ_CST);
+}
+
+void
+sge_live_leave(sge_live* live, int reader) {
+	__atomic_store_n(&live->readers[reader].epoch, READER_IDLE, __ATOMIC_RELEASE);
+}
+
+// free what no reader can see any more, returns how many contexts are still waiting
+int
+sge_live_reclaim(sge_live* live) {
+	int i, pending = 0;
+	uint64_t epoch, oldest = UINT64_MAX;
+	sge_retired** link, *r;
+
+	if (NULL == live) {
+		return INVALID_PARAM;
+	}
+
+	for (i = 0; i < SGE_LIVE_MAX_READERS; ++i) {
+		epoch = __atomic_load_n(&live->readers[i].epoch, __ATOMIC_SEQ_CST);
+		if (epoch != READER_IDLE && epoch < oldest) {
+			oldest = epoch;
+		}
+	}
+
+	link = &live->retired;
+	while ((r = *link)) {
+		if (r->epoch <= oldest) {
+			*link = r->next;
+			sge_ctx_free(r->ctx);
+			sge_free(r);
+		} else {
+			link = &r->next;
+			pending++;
+		}
+	}
+	return pending;
+}
+
+// readers entering after this see ctx, the old context is freed by this or a later reclaim
+int
+sge_live_publish(sge_live* live, sge_context* ctx) {
+	sge_retired* r;
+	sge_context* old;
+
+	if (NULL == live || NULL == ctx) {
+		return INVALID_PARAM;
+	}
+
+	r = sge_malloc(sizeof(sge_retired));
+	if (NULL == r) {
+		return SGE_ERR;
+	}
+
+	old = __atomic_exchange_n(&live->current, ctx, __ATOMIC_SEQ_CST);
+	r->ctx = old;
+	r->epoch = __atomic_add_fetch(&live->epoch, 1, __ATOMIC_SEQ_CST);
+	r->next = live->retired;
+	live->retired = r;
+
+	sge_live_reclaim(live);
+	return SGE_OK;
+}
+
+// parse text into a new context with the options of the current one and publish it
+int
+sge_live_parse(sge_live* live, const char* text) {
+	int ret;
+	const sge_context* current;
+	sge_context* ctx;
+
+	if (NULL == live || NULL == text) {
+		return INVALID_PARAM;
+	}
+
+	ctx = sge_ctx_new();
+	if (NULL == ctx) {
+		return SGE_ERR;
+	}
+	current = __atomic_load_n(&live->current, __ATOMIC_ACQUIRE);
+	ctx->integrity = current->integrity;
+	ctx->version = current->version;
+	ctx->presence = current->presence;
+	ctx->defaults = current->defaults;
+
+	ret = sge_ctx_parse(ctx, text);
+	if (SGE_OK != ret) {
+		sge_ctx_free(ctx);
+		return ret;
+	}
+
+	ret = sge_live_publish(live, ctx);
+	if (SGE_OK != ret) {
+		sge_ctx_free(ctx);
+	}
+	return ret;
+}
@@ -0,0 +1,23 @@
+#ifndef SGE_LIVE_H_
+#define SGE_LIVE_H_
+
+#include "sge_proto.h"
+
+#define SGE_LIVE_MAX_READERS	128
+
+// a published context that can be replaced while other threads keep encoding and decoding.
+// readers bracket every use with sge_live_enter/sge_live_leave and never block; a replaced context
+// is freed once every reader that could still see it has left. one thread publishes at a time.
+typedef struct sge_live sge_live;
+
+sge_live* sge_live_new(sge_context* ctx);
+void sge_live_free(sge_live* live);
+int sge_live_register(sge_live* live);
+void sge_live_unregister(sge_live* live, int reader);
+const sge_context* sge_live_enter(sge_live* live, int reader);
+void sge_live_leave(sge_live* live, int reader);
+int sge_live_publish(sge_live* live, sge_context* ctx);
+int sge_live_parse(sge_live* live, const char* text);
+int sge_live_reclaim(sge_live* live);
+
+#endif
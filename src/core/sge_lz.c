@@ -0,0 +1,237 @@
+#include <string.h>
+#include "sge_lz.h"
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+#define LZ_MAX_OFFSET 65535
+#define LZ_RUN_MASK 15
+#define LZ_LAST_LITERALS 5	// matches stop this far before the end
+#define LZ_MATCH_LIMIT 12	// and don't start in the last bytes
+#define LZ_SKIP_SHIFT 5		// after 32 misses in a row the scan takes bigger steps
+
+static uint32_t
+read32(const uint8_t* p) {
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+// how many bytes p and ref have in common, not reading limit or beyond
+static size_t
+common_length(const uint8_t* p, const uint8_t* ref, const uint8_t* limit) {
+	const uint8_t* start = p;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	uint64_t a, b;
+
+	while (p + 8 <= limit) {
+		memcpy(&a, p, 8);
+		memcpy(&b, ref, 8);
+		if (a != b) {
+			return p - start + (__builtin_ctzll(a ^ b) >> 3);
+		}
+		p += 8;
+		ref += 8;
+	}
+#endif
+	while (p < limit && *p == *ref) {
+		++p;
+		++ref;
+	}
+	return p - start;
+}
+
+static uint32_t
+hash4(const uint8_t* p) {
+	return (read32(p) * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+// 15 in the token, then bytes of 255 and the remainder
+static uint8_t*
+write_length(uint8_t* op, const uint8_t* oend, size_t n) {
+	for (n -= LZ_RUN_MASK; n >= 255; n -= 255) {
+		if (op >= oend) {
+			return NULL;
+		}
+		*op++ = 255;
+	}
+	if (op >= oend) {
+		return NULL;
+	}
+	*op++ = (uint8_t)n;
+	return op;
+}
+
+static uint8_t*
+write_sequence(uint8_t* op, const uint8_t* oend, const uint8_t* lit, size_t lit_len, size_t offset, size_t match_len) {
+	uint8_t* token;
+
+	if (op >= oend) {
+		return NULL;
+	}
+	token = op++;
+	*token = (lit_len >= LZ_RUN_MASK ? LZ_RUN_MASK : lit_len) << 4;
+	if (lit_len >= LZ_RUN_MASK && NULL == (op = write_length(op, oend, lit_len))) {
+		return NULL;
+	}
+	if ((size_t)(oend - op) < lit_len) {
+		return NULL;
+	}
+	memcpy(op, lit, lit_len);
+	op += lit_len;
+	if (match_len == 0) {
+		return op;
+	}
+
+	if (oend - op < 2) {
+		return NULL;
+	}
+	*op++ = offset & 0xff;
+	*op++ = offset >> 8;
+	match_len -= LZ_MIN_MATCH;
+	*token |= match_len >= LZ_RUN_MASK ? LZ_RUN_MASK : match_len;
+	if (match_len >= LZ_RUN_MASK) {
+		op = write_length(op, oend, match_len);
+	}
+	return op;
+}
+
+// reads the extension bytes of a length that was 15 in the token
+static const uint8_t*
+read_length(const uint8_t* ip, const uint8_t* iend, size_t* n) {
+	uint8_t b;
+
+	do {
+		if (ip >= iend) {
+			return NULL;
+		}
+		b = *ip++;
+		*n += b;
+	} while (b == 255);
+	return ip;
+}
+
+int
+sge_lz_compress(const char* in, size_t len, char* out, size_t capacity) {
+	uint32_t table[1 << LZ_HASH_BITS];
+	const uint8_t* base = (const uint8_t*)in;
+	const uint8_t* ip = base;
+	const uint8_t* anchor = base;
+	const uint8_t* iend = base + len;
+	const uint8_t* ref;
+	uint8_t* op = (uint8_t*)out;
+	const uint8_t* oend = op + capacity;
+	size_t match_len;
+	uint32_t h, misses = 0;
+
+	if (NULL == in || NULL == out || len > INT32_MAX) {
+		return -1;
+	}
+
+	if (len > LZ_MATCH_LIMIT) {
+		memset(table, 0, sizeof(table));
+		for (ip = base + 1; ip < iend - LZ_MATCH_LIMIT; ) {
+			h = hash4(ip);
+			ref = base + table[h];
+			table[h] = (uint32_t)(ip - base);
+			if (ref >= ip || ip - ref > LZ_MAX_OFFSET || read32(ref) != read32(ip)) {
+				ip += 1 + (misses++ >> LZ_SKIP_SHIFT);
+				continue;
+			}
+			misses = 0;
+
+			while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+				--ip;
+				--ref;
+			}
+			match_len = LZ_MIN_MATCH + common_length(ip + LZ_MIN_MATCH, ref + LZ_MIN_MATCH, iend - LZ_LAST_LITERALS);
+
+			op = write_sequence(op, oend, anchor, ip - anchor, ip - ref, match_len);
+			if (NULL == op) {
+				return -1;
+			}
+			ip += match_len;
+			anchor = ip;
+			if (ip < iend - LZ_MATCH_LIMIT) {
+				table[hash4(ip - 2)] = (uint32_t)(ip - 2 - base);
+			}
+		}
+	}
+
+	op = write_sequence(op, oend, anchor, iend - anchor, 0, 0);
+	if (NULL == op) {
+		return -1;
+	}
+	return op - (uint8_t*)out;
+}
+
+int
+sge_lz_decompress(const char* in, size_t len, char* out, size_t capacity) {
+	const uint8_t* ip = (const uint8_t*)in;
+	const uint8_t* iend = ip + len;
+	uint8_t* op = (uint8_t*)out;
+	uint8_t* oend = op + capacity;
+	uint8_t* end;
+	const uint8_t* ref;
+	size_t lit_len, match_len, offset;
+	uint8_t token;
+
+	if (NULL == in || NULL == out || len == 0) {
+		return -1;
+	}
+
+	for (;;) {
+		if (ip >= iend) {
+			return -1;
+		}
+		token = *ip++;
+		lit_len = token >> 4;
+		if (lit_len == LZ_RUN_MASK && NULL == (ip = read_length(ip, iend, &lit_len))) {
+			return -1;
+		}
+		if ((size_t)(iend - ip) < lit_len || (size_t)(oend - op) < lit_len) {
+			return -1;
+		}
+		if (lit_len <= 16 && iend - ip >= 16 && oend - op >= 16) {
+			// short runs copy a fixed 16 bytes while both sides have room, the extra bytes are overwritten later
+			memcpy(op, ip, 16);
+		} else {
+			memcpy(op, ip, lit_len);
+		}
+		ip += lit_len;
+		op += lit_len;
+		if (ip == iend) {
+			break;
+		}
+
+		if (iend - ip < 2) {
+			return -1;
+		}
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		match_len = token & LZ_RUN_MASK;
+		if (match_len == LZ_RUN_MASK && NULL == (ip = read_length(ip, iend, &match_len))) {
+			return -1;
+		}
+		match_len += LZ_MIN_MATCH;
+		if (offset == 0 || offset > (size_t)(op - (uint8_t*)out) || (size_t)(oend - op) < match_len) {
+			return -1;
+		}
+		if (offset >= 8 && (size_t)(oend - op) >= match_len + 8) {
+			// 8 byte steps never read bytes this copy hasn't written yet
+			for (ref = op - offset, end = op + match_len; op < end; op += 8, ref += 8) {
+				memcpy(op, ref, 8);
+			}
+			op = end;
+		} else if (offset >= match_len) {
+			memcpy(op, op - offset, match_len);
+			op += match_len;
+		} else {
+			// overlapping copy repeats the last offset bytes
+			while (match_len--) {
+				*op = *(op - offset);
+				++op;
+			}
+		}
+	}
+	return op - (uint8_t*)out;
+}
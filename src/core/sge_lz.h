@@ -0,0 +1,14 @@
+#ifndef SGE_LZ_H_
+#define SGE_LZ_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// byte oriented LZ77 in the LZ4 block layout: a token with 4 bit literal and match lengths, the literals, a 2 byte
+// little endian offset and the length extensions; the last sequence has literals only.
+// both return the size written, or -1 when the output doesn't fit in capacity or the input is malformed;
+// decompressing may leave scratch bytes after the returned size, never past capacity
+int sge_lz_compress(const char* in, size_t len, char* out, size_t capacity);
+int sge_lz_decompress(const char* in, size_t len, char* out, size_t capacity);
+
+#endif
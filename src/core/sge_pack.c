@@ -0,0 +1,281 @@
+#include <string.h>
+#include "sge_proto.h"
+#include "sge_pack.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SGE_PACK_SIMD 1
+#endif
+
+#define PACK_UNIT_SIZE 8
+
+typedef char* (*pack_fn)(const char*, const char*, char*);
+typedef char* (*unpack_fn)(const char*, const char*, char*, const char*);
+typedef const char* (*unpack_groups_fn)(const char*, const char*, char*, size_t*);
+
+// per mask byte: the pshufb control that gathers the kept bytes of a group to its front, the control that spreads
+// them back to their places (0x80 makes pshufb write a zero), and the number of kept bytes
+static uint8_t pack_shuffle[256][PACK_UNIT_SIZE];
+static uint8_t unpack_shuffle[256][PACK_UNIT_SIZE];
+static uint8_t pack_count[256];
+
+static char*
+pack_scalar(const char* p_in, const char* end, char* p_out) {
+	int move_step;
+	char* mask;
+
+	while (p_in < end) {
+		mask = p_out++;
+		*mask = 0;
+		for (move_step = 0; move_step < PACK_UNIT_SIZE && p_in < end; ++move_step, ++p_in) {
+			if (*p_in) {
+				*p_out++ = *p_in;
+				*mask |= (1 << move_step);
+			}
+		}
+	}
+	return p_out;
+}
+
+// a group is spread to 8 bytes while input is left after it, the last one stops after its last kept byte
+static char*
+unpack_scalar(const char* p_in, const char* end, char* p_out, const char* out_end) {
+	int move_step;
+	uint8_t mask;
+
+	while (p_in < end) {
+		mask = (uint8_t)*p_in++;
+		for (move_step = 0; move_step < PACK_UNIT_SIZE && p_in < end; ++move_step) {
+			if (p_out >= out_end) {
+				return NULL;
+			}
+			*p_out++ = (mask & (1 << move_step)) ? *p_in++ : 0;
+		}
+	}
+	return p_out;
+}
+
+static const char*
+unpack_groups_scalar(const char* p_in, const char* end, char* p_out, size_t* groups) {
+	int move_step;
+	uint8_t mask;
+	size_t n;
+
+	for (n = 0; n < *groups && p_in < end; ++n) {
+		mask = (uint8_t)*p_in++;
+		if (end - p_in < pack_count[mask]) {
+			return NULL;
+		}
+		for (move_step = 0; move_step < PACK_UNIT_SIZE; ++move_step) {
+			*p_out++ = (mask & (1 << move_step)) ? *p_in++ : 0;
+		}
+	}
+	*groups = n;
+	return p_in;
+}
+
+#ifdef SGE_PACK_SIMD
+// the 8 byte stores may run past what a group keeps, but never past the 9 bytes a full group can take
+__attribute__((target("ssse3"))) static char*
+pack_ssse3(const char* p_in, const char* end, char* p_out) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i upper = _mm_set1_epi8(PACK_UNIT_SIZE);
+	__m128i v, ctrl;
+	unsigned bits, lo, hi;
+
+	while (end - p_in >= 2 * PACK_UNIT_SIZE) {
+		v = _mm_loadu_si128((const __m128i*)p_in);
+		bits = ~(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+		lo = bits & 0xff;
+		hi = (bits >> 8) & 0xff;
+
+		*p_out = (char)lo;
+		ctrl = _mm_loadl_epi64((const __m128i*)pack_shuffle[lo]);
+		_mm_storel_epi64((__m128i*)(p_out + 1), _mm_shuffle_epi8(v, ctrl));
+		p_out += 1 + pack_count[lo];
+
+		// 0x80 + 8 still has the high bit set, so the same table serves the upper group
+		*p_out = (char)hi;
+		ctrl = _mm_add_epi8(_mm_loadl_epi64((const __m128i*)pack_shuffle[hi]), upper);
+		_mm_storel_epi64((__m128i*)(p_out + 1), _mm_shuffle_epi8(v, ctrl));
+		p_out += 1 + pack_count[hi];
+
+		p_in += 2 * PACK_UNIT_SIZE;
+	}
+	return pack_scalar(p_in, end, p_out);
+}
+
+__attribute__((target("avx2"))) static char*
+pack_avx2(const char* p_in, const char* end, char* p_out) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i upper = _mm256_set_epi64x(0x0808080808080808LL, 0, 0x0808080808080808LL, 0);
+	__m256i v, ctrl;
+	__m128i half;
+	uint64_t c0, c1, c2, c3;
+	uint32_t bits;
+	unsigned m0, m1, m2, m3;
+
+	while (end - p_in >= 4 * PACK_UNIT_SIZE) {
+		v = _mm256_loadu_si256((const __m256i*)p_in);
+		bits = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero));
+		m0 = bits & 0xff;
+		m1 = (bits >> 8) & 0xff;
+		m2 = (bits >> 16) & 0xff;
+		m3 = bits >> 24;
+
+		// pshufb stays inside each 128 bit lane: groups 1 and 3 pick from the upper half of theirs
+		memcpy(&c0, pack_shuffle[m0], 8);
+		memcpy(&c1, pack_shuffle[m1], 8);
+		memcpy(&c2, pack_shuffle[m2], 8);
+		memcpy(&c3, pack_shuffle[m3], 8);
+		ctrl = _mm256_add_epi8(_mm256_set_epi64x(c3, c2, c1, c0), upper);
+		v = _mm256_shuffle_epi8(v, ctrl);
+
+		half = _mm256_castsi256_si128(v);
+		*p_out = (char)m0;
+		_mm_storel_epi64((__m128i*)(p_out + 1), half);
+		p_out += 1 + pack_count[m0];
+		*p_out = (char)m1;
+		_mm_storel_epi64((__m128i*)(p_out + 1), _mm_unpackhi_epi64(half, half));
+		p_out += 1 + pack_count[m1];
+
+		half = _mm256_extracti128_si256(v, 1);
+		*p_out = (char)m2;
+		_mm_storel_epi64((__m128i*)(p_out + 1), half);
+		p_out += 1 + pack_count[m2];
+		*p_out = (char)m3;
+		_mm_storel_epi64((__m128i*)(p_out + 1), _mm_unpackhi_epi64(half, half));
+		p_out += 1 + pack_count[m3];
+
+		p_in += 4 * PACK_UNIT_SIZE;
+	}
+	return pack_ssse3(p_in, end, p_out);
+}
+
+// a group whose 8 data bytes can be loaded and that has input after it always spreads to 8 bytes
+__attribute__((target("ssse3"))) static char*
+unpack_ssse3(const char* p_in, const char* end, char* p_out, const char* out_end) {
+	__m128i data, ctrl;
+	uint8_t mask;
+
+	while (end - p_in >= PACK_UNIT_SIZE + 2 && out_end - p_out >= PACK_UNIT_SIZE) {
+		mask = (uint8_t)*p_in;
+		data = _mm_loadl_epi64((const __m128i*)(p_in + 1));
+		ctrl = _mm_loadl_epi64((const __m128i*)unpack_shuffle[mask]);
+		_mm_storel_epi64((__m128i*)p_out, _mm_shuffle_epi8(data, ctrl));
+		p_in += 1 + pack_count[mask];
+		p_out += PACK_UNIT_SIZE;
+	}
+	return unpack_scalar(p_in, end, p_out, out_end);
+}
+
+__attribute__((target("ssse3"))) static const char*
+unpack_groups_ssse3(const char* p_in, const char* end, char* p_out, size_t* groups) {
+	__m128i data, ctrl;
+	uint8_t mask;
+	size_t n, rest;
+
+	for (n = 0; n < *groups && end - p_in > PACK_UNIT_SIZE; ++n) {
+		mask = (uint8_t)*p_in;
+		data = _mm_loadl_epi64((const __m128i*)(p_in + 1));
+		ctrl = _mm_loadl_epi64((const __m128i*)unpack_shuffle[mask]);
+		_mm_storel_epi64((__m128i*)p_out, _mm_shuffle_epi8(data, ctrl));
+		p_in += 1 + pack_count[mask];
+		p_out += PACK_UNIT_SIZE;
+	}
+	rest = *groups - n;
+	p_in = unpack_groups_scalar(p_in, end, p_out, &rest);
+	*groups = n + rest;
+	return p_in;
+}
+#endif
+
+static pack_fn pack_impl = pack_scalar;
+static unpack_fn unpack_impl = unpack_scalar;
+static unpack_groups_fn unpack_groups_impl = unpack_groups_scalar;
+static const char* kernel_name = "scalar";
+
+__attribute__((constructor)) static void
+init_pack() {
+	int mask, i, kept;
+
+	for (mask = 0; mask < 256; ++mask) {
+		memset(pack_shuffle[mask], 0x80, PACK_UNIT_SIZE);
+		for (i = 0, kept = 0; i < PACK_UNIT_SIZE; ++i) {
+			if (mask & (1 << i)) {
+				pack_shuffle[mask][kept] = i;
+				unpack_shuffle[mask][i] = kept++;
+			} else {
+				unpack_shuffle[mask][i] = 0x80;
+			}
+		}
+		pack_count[mask] = kept;
+	}
+
+#ifdef SGE_PACK_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("ssse3")) {
+		pack_impl = pack_ssse3;
+		unpack_impl = unpack_ssse3;
+		unpack_groups_impl = unpack_groups_ssse3;
+		kernel_name = "ssse3";
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		pack_impl = pack_avx2;
+		kernel_name = "avx2";
+	}
+#endif
+}
+
+char*
+sge_pack_span(const char* p_in, const char* end, char* p_out) {
+	return pack_impl(p_in, end, p_out);
+}
+
+char*
+sge_unpack_span(const char* p_in, const char* end, char* p_out, const char* out_end) {
+	return unpack_impl(p_in, end, p_out, out_end);
+}
+
+const char*
+sge_unpack_groups(const char* p_in, const char* end, char* p_out, size_t* groups) {
+	return unpack_groups_impl(p_in, end, p_out, groups);
+}
+
+size_t
+sge_packed_size(const char* p_in, const char* end) {
+	const uint64_t low7 = 0x7f7f7f7f7f7f7f7fULL;
+	size_t len = end - p_in, zeros = 0;
+	uint64_t v;
+
+	// a byte keeps its high bit after this only when it was zero
+	for (; end - p_in >= 8; p_in += 8) {
+		memcpy(&v, p_in, 8);
+		zeros += __builtin_popcountll(~(((v & low7) + low7) | v | low7));
+	}
+	for (; p_in < end; ++p_in) {
+		zeros += (*p_in == 0);
+	}
+	return len - zeros + (len + PACK_UNIT_SIZE - 1) / PACK_UNIT_SIZE;
+}
+
+const char*
+sge_pack_kernel(void) {
+	return kernel_name;
+}
+
+int
+sge_pack(const char* in_str, int len, char* out_str) {
+	if (in_str == NULL || out_str == NULL || len <= 0) {
+		return INVALID_PARAM;
+	}
+	return sge_pack_span(in_str, in_str + len, out_str) - out_str;
+}
+
+int
+sge_unpack(const char* in_str, int len, char* out_str) {
+	if (in_str == NULL || out_str == NULL || len <= 0) {
+		return INVALID_PARAM;
+	}
+	return sge_unpack_span(in_str, in_str + len, out_str, out_str + (size_t)len * PACK_UNIT_SIZE) - out_str;
+}
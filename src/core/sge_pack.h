@@ -0,0 +1,23 @@
+#ifndef SGE_PACK_H_
+#define SGE_PACK_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// zero packing: every group of 8 bytes becomes a mask byte, bit i set when byte i isn't zero, followed by the
+// non zero bytes. the span functions work on [p_in, end) and return the end of what they wrote to p_out;
+// packing writes at most (end - p_in) + (end - p_in + 7) / 8 bytes, unpacking stops with NULL before passing out_end
+char* sge_pack_span(const char* p_in, const char* end, char* p_out);
+char* sge_unpack_span(const char* p_in, const char* end, char* p_out, const char* out_end);
+
+// spreads up to *groups groups of [p_in, end) to 8 bytes each, the zeros at the end of the last one included, sets
+// *groups to the number written and returns where they ended in the input, NULL when a group is missing kept bytes
+const char* sge_unpack_groups(const char* p_in, const char* end, char* p_out, size_t* groups);
+
+// the size sge_pack_span would return for [p_in, end)
+size_t sge_packed_size(const char* p_in, const char* end);
+
+// name of the kernel picked for this CPU: "avx2", "ssse3" or "scalar"
+const char* sge_pack_kernel(void);
+
+#endif
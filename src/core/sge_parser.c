@@ -78,7 +78,7 @@ trim_right(sge_text* text) {
 		return;
 	}
 
-	while(filter_blank_char(text) == SGE_OK);
+	while(!empty_buffer(text) && filter_blank_char(text) == SGE_OK);
 }
 
 static void
@@ -105,7 +105,7 @@ parse_field_delimiter(sge_proto* proto) {
 	sge_text* text = &proto->text;
 	char c = *text->cursor;
 	if (c != FIELD_DELIMITER) {
-		SET_ERROR(proto, "parse field fail at line %ld\n", text->lineno);
+		SET_ERROR("parse field fail at line %ld\n", text->lineno);
 		return SGE_ERR;
 	}
 	text->cursor++;
@@ -149,7 +149,6 @@ static sge_block*
 add_block(sge_proto* proto, sge_block* block) {
 	LIST_ADD_TAIL(&(proto->block_head), &(block->head));
 	sge_table_insert(proto->ht_name, block->name, strlen(block->name), block);
-	sge_table_insert(proto->ht_idx, (void*)&block->idx, 0, block);
     return SGE_OK;
 }
 
@@ -162,7 +161,7 @@ parse_name(sge_proto* proto, char* err_info, const char** name) {
 	c = *text->cursor;
 	p = text->cursor;
 	if (VALID_NUMBER(c)) {
-		SET_ERROR(proto, "invalid %s name at line %ld.\n", err_info, text->lineno);
+		SET_ERROR("invalid %s name at line %ld.\n", err_info, text->lineno);
 		return SGE_ERR;
 	}
 
@@ -174,7 +173,7 @@ parse_name(sge_proto* proto, char* err_info, const char** name) {
 		c = *text->cursor;
 	}
 	if (p == text->cursor) {
-		SET_ERROR(proto, "invalid %s name at line %ld.\n", err_info, text->lineno);
+		SET_ERROR("invalid %s name at line %ld.\n", err_info, text->lineno);
 		return SGE_ERR;
 	}
 	*name = p;
@@ -186,7 +185,7 @@ parse_field_end(sge_proto* proto) {
 	sge_text* text = &proto->text;
 	char c = *text->cursor;
 	if (c != FIELD_TERMINATOR) {
-		SET_ERROR(proto, "can't found field terminator at line %ld\n", text->lineno);
+		SET_ERROR("can't found field terminator at line %ld\n", text->lineno);
 		return SGE_ERR;
 	}
 	text->cursor++;
@@ -233,7 +232,7 @@ parse_protocol_field(sge_proto* proto) {
 		return NULL;
 	}
 
-	ret = sge_add_field(field_name, field_name_len, field_type, field_type_len, &field);
+	ret = sge_add_field(proto, field_name, field_name_len, field_type, field_type_len, &field);
 	if (SGE_ERR == ret) {
 		unfinished_field = alloc_unfinished_field(field, field_type, field_type_len);
 		LIST_ADD_TAIL(&(proto->unfinished_fields), &(unfinished_field->entry));
@@ -251,7 +250,7 @@ parse_protocol_body(sge_proto* proto, sge_list* field_head) {
 
 	c = *text->cursor;
 	if (c != LEFT_BODY_CHAR) {
-		SET_ERROR(proto, "can't found '{' at line %ld\n", text->lineno);
+		SET_ERROR("can't found '{' at line %ld\n", text->lineno);
 		return SGE_ERR;
 	}
 
@@ -274,7 +273,7 @@ parse_protocol_body(sge_proto* proto, sge_list* field_head) {
 	}
 
 	if (c != RIGHT_BODY_CHAR) {
-		SET_ERROR(proto, "can't found '}' at line %ld\n", text->lineno);
+		SET_ERROR("can't found '}' at line %ld\n", text->lineno);
 		return SGE_ERR;
 	}
 	if (field_size == 0) {
@@ -302,7 +301,7 @@ parse_protocol_idx(sge_proto* proto, const char** p_idx) {
 		c = *text->cursor;
 	}
 	if (p == text->cursor) {
-		SET_ERROR(proto, "invalid protocol idx at line %ld.\n", text->lineno);
+		SET_ERROR("invalid protocol idx at line %ld.\n", text->lineno);
 		return SGE_ERR;
 	}
 	*p_idx = p;
@@ -337,7 +336,7 @@ parse_protocol_(sge_proto* proto) {
 	field_size = parse_protocol_body(proto, &block->field_head);
 	if (field_size <= 0) {
 		if (field_size == 0) {
-			SET_ERROR(proto, "protocol: %.*s is empty at line %ld\n", proto_name_len, proto_name, text->lineno);
+			SET_ERROR("protocol: %.*s is empty at line %ld\n", proto_name_len, proto_name, text->lineno);
 		}
 		goto ERR;
 	}
@@ -360,13 +359,12 @@ parse_unfinished_field(sge_proto* proto) {
 	ret = SGE_OK;
 	LIST_FOREACH_SAFE(iter, next, &proto->unfinished_fields) {
 		unfinished_field = LIST_DATA(iter, sge_unfinished_field, entry);
-		sge_get_block(unfinished_field->field_type, unfinished_field->field_type_len, &block);
-		if (NULL == block) {
-			SET_ERROR(proto, "can't found custom type %.*s\n", (int)unfinished_field->field_type_len, unfinished_field->field_type);
+		sge_get_block(proto, unfinished_field->field_type, unfinished_field->field_type_len, &block);
+		if (NULL == block && ret == SGE_OK) {
+			SET_ERROR("can't found custom type %.*s\n", (int)unfinished_field->field_type_len, unfinished_field->field_type);
 			ret = SGE_ERR;
-			break;
 		}
-		
+
 		unfinished_field->field->block = block;
 		LIST_REMOVE(&(unfinished_field->entry));
 		sge_free(unfinished_field);
@@ -375,13 +373,54 @@ parse_unfinished_field(sge_proto* proto) {
 	return ret;
 }
 
+static int
+compile_protocol(sge_proto* proto) {
+	sge_list* iter;
+	sge_block* block;
+
+	LIST_FOREACH(iter, &proto->block_head) {
+		block = LIST_DATA(iter, sge_block, head);
+		if (SGE_ERR == sge_compile_block(block)) {
+			SET_ERROR("can't compile protocol %s, out of memory\n", block->name);
+			return SGE_ERR;
+		}
+	}
+
+	LIST_FOREACH(iter, &proto->block_head) {
+		block = LIST_DATA(iter, sge_block, head);
+		sge_bound_block(block);
+		block->ctx = proto;
+	}
+
+	if (SGE_ERR == sge_index_build(&proto->index, &proto->block_head)) {
+		SET_ERROR("can't build protocol index, protocol idx must be less than %d\n", SGE_MAX_BLOCK_IDX + 1);
+		return SGE_ERR;
+	}
+	return SGE_OK;
+}
+
+static void
+free_unfinished_field(sge_proto* proto) {
+	sge_list* iter, *next;
+
+	LIST_FOREACH_SAFE(iter, next, &proto->unfinished_fields) {
+		LIST_REMOVE(iter);
+		sge_free(LIST_DATA(iter, sge_unfinished_field, entry));
+	}
+}
+
 static int
 parse_protocol(sge_proto* proto) {
 	if (SGE_ERR == parse_protocol_(proto)) {
+		free_unfinished_field(proto);
+		return SGE_ERR;
+	}
+
+	if (SGE_ERR == parse_unfinished_field(proto)) {
 		return SGE_ERR;
 	}
 
-	return parse_unfinished_field(proto);
+	return compile_protocol(proto);
 }
 
 // export
@@ -1,13 +1,16 @@
 #ifndef SGE_PARSER_H_
 #define SGE_PARSER_H_
 
+#include "sge_proto.h"
 #include "sge_block.h"
 #include "sge_table.h"
+#include "sge_index.h"
 
-#define SET_ERROR(proto, ...)						\
-do {												\
-	int s = sprintf((proto)->err, __VA_ARGS__);		\
-	(proto)->err[s] = '\0';							\
+#define SGE_ERROR_SIZE	1024
+
+#define SET_ERROR(...)										\
+do {														\
+	snprintf(sge_error_buffer(), SGE_ERROR_SIZE, __VA_ARGS__);	\
 } while(0)
 
 typedef struct {
@@ -17,20 +20,27 @@ typedef struct {
 	const char *cursor;
 } sge_text;
 
-typedef struct {
+struct sge_context {
 	int init;
+	int integrity;
+	int version;
+	int presence;
+	int defaults;
 	sge_text text;
 	sge_list block_head;
 	sge_list unfinished_fields;
 	sge_table *ht_name;
-	sge_table *ht_idx;
-	char err[1024];
-} sge_proto;
+	sge_index index;
+};
+
+typedef struct sge_context sge_proto;
 
 
 int sge_parse_protocol(sge_proto* proto);
-int sge_add_field(const char* field_name, size_t field_name_len, const char* type, size_t type_len, sge_field** field);
-int sge_get_block(const char* type, size_t type_len, sge_block** block);
+char* sge_error_buffer();
+int sge_add_field(const sge_context* ctx, const char* field_name, size_t field_name_len, const char* type, size_t type_len, sge_field** field);
+int sge_get_block(const sge_context* ctx, const char* type, size_t type_len, sge_block** block);
+const sge_context* sge_get_protocol();
 
 
 #endif
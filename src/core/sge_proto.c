@@ -1,23 +1,73 @@
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
+#include <stddef.h>
 
 #include "sge_proto.h"
 #include "sge_block.h"
 #include "sge_parser.h"
 #include "sge_crc16.h"
-
-#define PACK_UNIT_SIZE 8
-
-static const char *SGE_PROTOCOL_HEADER = "01";
-static const uint8_t SGE_PROTOCOL_HEADER_SIZE = 2;
+#include "sge_crc32c.h"
+#include "sge_pack.h"
+#include "sge_lz.h"
+
+// [check:2][integrity:1][version:1][protocol id:2], "01" is CRC16 + version 1. frames with presence bitmaps write
+// the version as 'a', 'b' or 'c', "0b" is CRC16 + version 2 + bitmaps
+#define SGE_INTEGRITY_CHAR(mode) ('0' + (mode))
+#define SGE_VERSION_CHAR(version) ('0' + (version))
+#define SGE_PRESENCE_CHAR(version) ('a' - 1 + (version))
+
+// a presence bitmap has a bit per field of its block, LSB first, set when the field was written
+#define BITMAP_SIZE(block)	(((block)->size + 7) / 8)
+#define FIELD_PRESENT(bitmap, ordinal)	((bitmap)[(ordinal) >> 3] & (1 << ((ordinal) & 7)))
+
+// batch: [check:2][integrity:1]['B'][version:1][count:4][entries length:4], then per message
+// [protocol id:2][body length:4][body]; one check covers the whole container
+#define SGE_BATCH_CHAR	'B'
+
+// compressed frame: [check:2][integrity:1][stage:1][frame length:4][payload], checked like a frame. the stage char
+// takes the place of the version so decoders tell it apart from a plain frame or batch
+#define SGE_STAGE_PACK_CHAR	'P'
+#define SGE_STAGE_LZ_CHAR	'L'
+
+// output cursor of one encode call. without a sink, bytes that don't fit before end are only counted,
+// with one the full chunk is flushed and the cursor starts over at the sink buffer
+typedef struct {
+	field_get cb;
+	int version;
+	int integrity;
+	int presence;
+	int err;
+	uint8_t* cur;
+	uint8_t* end;
+	size_t overflow;
+	sge_sink* sink;
+	size_t flushed;
+	size_t crc_skip;
+	uint32_t crc;
+} sge_encode_state;
+
+typedef struct {
+	field_set cb;
+	int version;
+	int presence;
+	int defaults;
+} sge_decode_state;
+
+static inline void
+set_field(sge_value* sv, const sge_field_code* code) {
+	sv->name = code->name;
+	sv->slot = code->slot;
+	sv->ordinal = code->ordinal;
+}
 
 static int
-sge_get_number(const void* ud, field_get_fn cb, const char* field_name, long* value, int idx) {
+sge_get_number(const void* ud, field_get_fn cb, const sge_field_code* code, long* value, int idx) {
 	long val = 0;
 	sge_value sv = NEW_SGE_VALUE;
 	sv.ptr = &val;
 	sv.idx = idx;
-	sv.name = field_name;
+	set_field(&sv, code);
 
 	cb(ud, &sv);
 	*value = val;
@@ -25,75 +75,211 @@ sge_get_number(const void* ud, field_get_fn cb, const char* field_name, long* va
 }
 
 static int
-sge_set_number(void* ud, field_set_fn cb, const char* field_name, long value, int idx) {
+sge_set_number(void* ud, field_set_fn cb, const sge_field_code* code, long value, int idx) {
 	sge_value sv = NEW_SGE_VALUE;
 	sv.idx = idx;
 	sv.ptr = &value;
-	sv.name = field_name;
+	set_field(&sv, code);
 	sv.vt = SGE_NUMBER;
 
 	cb(ud, &sv);
 	return SGE_OK;
 }
 
-static int
-sge_encode_block(const sge_block* block, const void* ud, uint8_t* buffer, field_get cb) {
-	sge_field *field;
-	sge_list* pf;
-	size_t offset = 0;
-	const uint8_t *start = buffer;
+static inline long
+sign_extend(long value, int size) {
+	int shift = (sizeof(long) - size) * 8;
+	return (long)((unsigned long)value << shift) >> shift;
+}
 
-	LIST_FOREACH(pf, &block->field_head) {
-		field = LIST_DATA(pf, sge_field, head);
-		offset = field->type->ops->encode(field, ud, buffer, cb);
-		buffer += offset;
+#define MAX_VARINT_SIZE 10
+
+// hand the buffered chunk to the sink, the trailing check is computed as chunks leave
+static void
+flush_sink(sge_encode_state* st) {
+	sge_sink* sink = st->sink;
+	size_t len = st->cur - (uint8_t*)sink->buffer;
+
+	if (st->integrity == SGE_INTEGRITY_CRC32C) {
+		st->crc = sge_crc32c_update(st->crc, sink->buffer + st->crc_skip, len - st->crc_skip);
+	} else if (st->integrity == SGE_INTEGRITY_CRC16) {
+		st->crc = sge_crc16_update(st->crc, sink->buffer + st->crc_skip, len - st->crc_skip);
+	}
+	st->crc_skip = 0;
+	st->cur = (uint8_t*)sink->buffer;
+	if (len == 0) {
+		return;
+	}
+	if (SGE_OK != sink->flush(sink, sink->buffer, len)) {
+		// stop writing, the rest is only counted
+		st->err = SGE_ERR;
+		st->sink = NULL;
+		st->end = st->cur;
+		return;
 	}
+	st->flushed += len;
+}
 
-	return buffer - start;
+static void
+write_slow(sge_encode_state* st, const uint8_t* data, size_t len) {
+	size_t n;
+
+	while (st->sink) {
+		n = st->end - st->cur;
+		n = n < len ? n : len;
+		memcpy(st->cur, data, n);
+		st->cur += n;
+		data += n;
+		len -= n;
+		if (len == 0) {
+			return;
+		}
+		flush_sink(st);
+	}
+	st->overflow += len;
+	st->end = st->cur;
 }
 
-static int
-sge_decode_block(const sge_block *block, void *ud, const uint8_t *buffer, field_set cb) {
-	sge_field *field;
-	sge_list* pf;
-	size_t offset = 0;
-	const uint8_t *start = buffer;
+// a NULL buffer only measures, nothing is copied to it even when len is 0
+static inline void
+write_bytes(sge_encode_state* st, const void* data, size_t len) {
+	if ((size_t)(st->end - st->cur) < len || NULL == st->cur) {
+		write_slow(st, data, len);
+		return;
+	}
+	memcpy(st->cur, data, len);
+	st->cur += len;
+}
 
-	LIST_FOREACH(pf, &block->field_head) {
-		field = LIST_DATA(pf, sge_field, head);
-		offset = field->type->ops->decode(field, ud, buffer, cb);
-		buffer += offset;
+static inline void
+write_byte(sge_encode_state* st, uint8_t c) {
+	if (st->cur == st->end) {
+		write_slow(st, &c, 1);
+		return;
 	}
+	*st->cur++ = c;
+}
 
-	return buffer - start;
+static inline void
+write_varint(sge_encode_state* st, uint64_t value) {
+	uint8_t tmp[MAX_VARINT_SIZE];
+
+	if (st->end - st->cur >= MAX_VARINT_SIZE) {
+		st->cur += sge_encode_varint(st->cur, value);
+		return;
+	}
+	write_bytes(st, tmp, sge_encode_varint(tmp, value));
 }
 
-static int
-sge_encode_dict(const sge_field *field, const void *ud, uint8_t *buffer, field_get cb, int32_t idx) {
-	uint8_t *start = buffer;
-	size_t offset = 0;
+static inline void
+write_number(sge_encode_state* st, long value, int size) {
+	uint8_t tmp[8];
+
+	if (st->end - st->cur >= size) {
+		st->cur += sge_encode_number(st->cur, value, size);
+		return;
+	}
+	write_bytes(st, tmp, sge_encode_number(tmp, value, size));
+}
+
+// version 1 and 3 write fixed width big endian, version 2 a zigzag varint of the same truncated value
+static inline void
+encode_integer(sge_encode_state* st, long value, int size) {
+	if (st->version == SGE_VERSION_2) {
+		write_varint(st, SGE_ZIGZAG(sign_extend(value, size)));
+		return;
+	}
+	write_number(st, value, size);
+}
+
+static inline int
+decode_integer(const sge_decode_state* st, const uint8_t* buffer, long* value, int size) {
+	int ret;
+	uint64_t v;
+
+	if (st->version == SGE_VERSION_2) {
+		ret = sge_decode_varint(buffer, &v);
+		*value = sign_extend(SGE_UNZIGZAG(v), size);
+		return ret;
+	}
+	return sge_decode_number(buffer, value, size);
+}
+
+// lengths and list counts: 2 bytes in version 1, varint in version 2, 4 bytes in version 3
+static inline void
+encode_length(sge_encode_state* st, size_t len) {
+	switch (st->version) {
+		case SGE_VERSION_2:
+			write_varint(st, len);
+			break;
+		case SGE_VERSION_3:
+			if (len > UINT32_MAX) {
+				st->err = LENGTH_OVERFLOW;
+			}
+			write_number(st, len, 4);
+			break;
+		default:
+			if (len > UINT16_MAX) {
+				st->err = LENGTH_OVERFLOW;
+			}
+			write_number(st, len, 2);
+			break;
+	}
+}
+
+static inline int
+decode_length(const sge_decode_state* st, const uint8_t* buffer, size_t* len) {
+	int ret;
+	uint64_t v;
+
+	switch (st->version) {
+		case SGE_VERSION_2:
+			ret = sge_decode_varint(buffer, &v);
+			*len = v;
+			return ret;
+		case SGE_VERSION_3:
+			*len = ((uint32_t)buffer[0] << 24) | (buffer[1] << 16) | (buffer[2] << 8) | buffer[3];
+			return 4;
+		default:
+			*len = (buffer[0] << 8) | buffer[1];
+			return 2;
+	}
+}
+
+static void sge_encode_block(const sge_block* block, const void* ud, sge_encode_state* st);
+static int sge_decode_block(const sge_block *block, void *ud, const uint8_t *buffer, const sge_decode_state* st);
+
+static void
+sge_encode_dict(const sge_field_code *code, const void *ud, sge_encode_state* st, int32_t idx) {
 	sge_value sv = NEW_SGE_VALUE;
 	sv.idx = idx;
-	sv.name = field->name;
+	set_field(&sv, code);
 
-	cb(ud, &sv);
+	st->cb(ud, &sv);
 
 	if (sv.ptr) {
-		*buffer = (sv.len & 0xff);
-		buffer++;
-		offset = sge_encode_block(field->block, sv.ptr, buffer, cb);
-		buffer += offset;
+		write_byte(st, 1);
+		sge_encode_block(code->block, sv.ptr, st);
 	} else {
-		*buffer = 0;
-		buffer++;
+		write_byte(st, 0);
 	}
-
-	return buffer - start;
 }
 
+// a custom value after its flag byte, or where it has none, a custom field behind a presence bitmap
 static int
-sge_decode_dict(const sge_field* field, void* ud, const uint8_t* buffer, field_set cb, int32_t idx) {
+decode_dict_body(const sge_field_code* code, void* ud, const uint8_t* buffer, const sge_decode_state* st, int32_t idx) {
 	sge_value sv = NEW_SGE_VALUE;
+
+	set_field(&sv, code);
+	sv.vt = SGE_DICT;
+	sv.idx = idx;
+	ud = st->cb(ud, &sv);
+
+	return sge_decode_block(code->block, ud, buffer, st);
+}
+
+static int
+sge_decode_dict(const sge_field_code* code, void* ud, const uint8_t* buffer, const sge_decode_state* st, int32_t idx) {
 	uint8_t len = 0;
 
 	len = (uint8_t)*buffer;
@@ -101,64 +287,54 @@ sge_decode_dict(const sge_field* field, void* ud, const uint8_t* buffer, field_s
 		return 1;
 	}
 
-	sv.name = field->name;
-	sv.vt = SGE_DICT;
-	sv.idx = idx;
-	ud = cb(ud, &sv);
-
-	return sge_decode_block(field->block, ud, buffer + 1, cb) + 1;
+	return decode_dict_body(code, ud, buffer + 1, st, idx) + 1;
 }
 
-static int
-encode_number(const sge_field* field, const void* ud, uint8_t* buffer, field_get_fn cb, int size, int idx) {
+static void
+encode_number(const sge_field_code* code, const void* ud, sge_encode_state* st, int idx) {
 	long value = 0;
-	sge_get_number(ud, cb, field->name, &value, idx);
-	return sge_encode_number(buffer, value, size);
+	sge_get_number(ud, st->cb, code, &value, idx);
+	encode_integer(st, value, code->width);
 }
 
 static int
-decode_number(const sge_field* field, void* ud, const uint8_t* buffer, field_set cb, int size, int idx) {
+decode_number(const sge_field_code* code, void* ud, const uint8_t* buffer, const sge_decode_state* st, int idx) {
 	int ret;
 	long value = 0;
 
-	ret = sge_decode_number(buffer, &value, size);
-	sge_set_number(ud, cb, field->name, value, idx);
+	ret = decode_integer(st, buffer, &value, code->width);
+	sge_set_number(ud, st->cb, code, value, idx);
 	return ret;
 }
 
-static int
-encode_number_list(const sge_field* field, const void* ud, uint8_t* buffer, field_get cb, int size) {
-	size_t idx = 0, offset = 0, len = 0;
+static void
+encode_number_list(const sge_field_code* code, const void* ud, sge_encode_state* st) {
+	size_t idx = 0;
 	sge_value sv = NEW_SGE_VALUE;
-	sv.name = field->name;
+	set_field(&sv, code);
 
-	cb(ud, &sv);
-	len = sge_encode_number(buffer, sv.len, 2);
-	buffer += len;
+	st->cb(ud, &sv);
+	encode_length(st, sv.len);
 	for (; idx < sv.len; ++idx) {
-		offset = encode_number(field, sv.ptr, buffer, cb, size, idx);
-		buffer += offset;
-		len += offset;
+		encode_number(code, sv.ptr, st, idx);
 	}
-
-	return len;
 }
 
 static int
-decode_number_list(const sge_field* field, void* ud, const uint8_t* buffer, field_set cb, int size) {
+decode_number_list(const sge_field_code* code, void* ud, const uint8_t* buffer, const sge_decode_state* st) {
 	size_t len = 0, i = 0;
 	size_t offset = 0, byte_len;
 	sge_value sv = NEW_SGE_VALUE;
 
-	byte_len = sge_decode_number(buffer, (long*)&len, 2);
+	byte_len = decode_length(st, buffer, &len);
 	buffer += byte_len;
 
 	sv.len = len;
-	sv.name = field->name;
+	set_field(&sv, code);
 	sv.vt = SGE_LIST;
-	ud = cb(ud, &sv);
+	ud = st->cb(ud, &sv);
 	for (; i < len; ++i) {
-		offset = decode_number(field, ud, buffer, cb, size, i);
+		offset = decode_number(code, ud, buffer, st, i);
 		buffer += offset;
 		byte_len += offset;
 	}
@@ -166,139 +342,104 @@ decode_number_list(const sge_field* field, void* ud, const uint8_t* buffer, fiel
 	return byte_len;
 }
 
-static int
-encode_string_ex(const sge_field* field, const void* ud, uint8_t* buffer, field_get cb, int idx) {
+static void
+encode_string_ex(const sge_field_code* code, const void* ud, sge_encode_state* st, int idx) {
 	sge_value sv = NEW_SGE_VALUE;
 	sv.idx = idx;
-	sv.name = field->name;
+	set_field(&sv, code);
 
-	cb(ud, &sv);
-	return sge_encode_string(buffer, sv.ptr, sv.len);
+	st->cb(ud, &sv);
+	encode_length(st, sv.len);
+	if (sv.ptr) {
+		write_bytes(st, sv.ptr, sv.len);
+	}
 }
 
 static int
-decode_string_ex(const sge_field* field, void* ud, const uint8_t* buffer, field_set cb, int idx) {
+decode_string_ex(const sge_field_code* code, void* ud, const uint8_t* buffer, const sge_decode_state* st, int idx) {
 	size_t len = 0;
-	char* ptr;
+	int offset;
 	sge_value sv = NEW_SGE_VALUE;
 	sv.idx = idx;
 
-	sge_decode_string(buffer, &ptr, &len);
+	offset = decode_length(st, buffer, &len);
 	if (len) {
-		sv.ptr = ptr;
+		sv.ptr = buffer + offset;
 		sv.len = len;
-		sv.name = field->name;
+		set_field(&sv, code);
 		sv.vt = SGE_STRING;
-		cb(ud, &sv);
+		st->cb(ud, &sv);
 	}
 
-	return len + 2;
-}
-
-static int
-encode_number8(const sge_field* field, const void* ud, uint8_t* buffer, field_get cb) {
-	return encode_number(field, ud, buffer, cb, 1, -1);
-}
-
-static int
-decode_number8(const sge_field* field, void* ud, const uint8_t* buffer, field_set cb) {
-	return decode_number(field, ud, buffer, cb, 1, -1);
-}
-
-static int
-encode_number16(const sge_field* field, const void* ud, uint8_t* buffer, field_get cb) {
-	return encode_number(field, ud, buffer, cb, 2, -1);
-}
-
-static int
-decode_number16(const sge_field* field, void* ud, const uint8_t* buffer, field_set cb) {
-	return decode_number(field, ud, buffer, cb, 2, -1);
-}
-
-static int
-encode_number32(const sge_field* field, const void* ud, uint8_t* buffer, field_get cb) {
-	return encode_number(field, ud, buffer, cb, 4, -1);
-}
-
-static int
-decode_number32(const sge_field* field, void* ud, const uint8_t* buffer, field_set cb) {
-	return decode_number(field, ud, buffer, cb, 4, -1);
-}
-
-static int
-encode_number8_list(const sge_field* field, const void* ud, uint8_t* buffer, field_get cb) {
-	return encode_number_list(field, ud, buffer, cb, 1);
+	return offset + len;
 }
 
-static int
-decode_number8_list(const sge_field* field, void* ud, const uint8_t* buffer, field_set cb) {
-	return decode_number_list(field, ud, buffer, cb, 1);
-}
+static void
+encode_string_list(const sge_field_code* code, const void* ud, sge_encode_state* st) {
+	size_t idx = 0;
+	sge_value sv = NEW_SGE_VALUE;
+	set_field(&sv, code);
 
-static int
-encode_number16_list(const sge_field* field, const void* ud, uint8_t* buffer, field_get cb) {
-	return encode_number_list(field, ud, buffer, cb, 2);
-}
+	st->cb(ud, &sv);
 
-static int
-decode_number16_list(const sge_field* field, void* ud, const uint8_t* buffer, field_set cb) {
-	return decode_number_list(field, ud, buffer, cb, 2);
+	encode_length(st, sv.len);
+	for (; idx < sv.len; ++idx) {
+		encode_string_ex(code, sv.ptr, st, idx);
+	}
 }
 
 static int
-encode_number32_list(const sge_field* field, const void* ud, uint8_t* buffer, field_get cb) {
-	return encode_number_list(field, ud, buffer, cb, 4);
-}
+decode_string_list(const sge_field_code* code, void* ud, const uint8_t* buffer, const sge_decode_state* st) {
+	size_t len = 0, i = 0;
+	size_t offset = 0, byte_len;
+	sge_value sv = NEW_SGE_VALUE;
 
-static int
-decode_number32_list(const sge_field* field, void* ud, const uint8_t* buffer, field_set cb) {
-	return decode_number_list(field, ud, buffer, cb, 4);
-}
+	byte_len = decode_length(st, buffer, &len);
+	buffer += byte_len;
 
-static int
-encode_string(const sge_field* field, const void* ud, uint8_t* buffer, field_get cb) {
-	return encode_string_ex(field, ud, buffer, cb, -1);
-}
+	sv.len = len;
+	set_field(&sv, code);
+	sv.vt = SGE_LIST;
+	ud = st->cb(ud, &sv);
+	for (; i < len; ++i) {
+		offset = decode_string_ex(code, ud, buffer, st, i);
+		buffer += offset;
+		byte_len += offset;
+	}
 
-static int
-decode_string(const sge_field* field, void* ud, const uint8_t* buffer, field_set cb) {
-	return decode_string_ex(field, ud, buffer, cb, -1);
+	return byte_len;
 }
 
-static int
-encode_string_list(const sge_field* field, const void* ud, uint8_t* buffer, field_get cb) {
-	size_t idx = 0, offset = 0, len = 0;
+static void
+encode_dict_list(const sge_field_code* code, const void* ud, sge_encode_state* st) {
+	size_t idx = 0;
 	sge_value sv = NEW_SGE_VALUE;
-	sv.name = field->name;
 
-	cb(ud, &sv);
+	set_field(&sv, code);
+	st->cb(ud, &sv);
 
-	len = sge_encode_number(buffer, sv.len, 2);
-	buffer += len;
+	encode_length(st, sv.len);
 	for (; idx < sv.len; ++idx) {
-		offset = encode_string_ex(field, sv.ptr, buffer, cb, idx);
-		buffer += offset;
-		len += offset;
+		sge_encode_dict(code, sv.ptr, st, idx);
 	}
-
-	return len;
 }
 
 static int
-decode_string_list(const sge_field* field, void* ud, const uint8_t* buffer, field_set cb) {
+decode_dict_list(const sge_field_code* code, void* ud, const uint8_t* buffer, const sge_decode_state* st) {
 	size_t len = 0, i = 0;
 	size_t offset = 0, byte_len;
 	sge_value sv = NEW_SGE_VALUE;
 
-	byte_len = sge_decode_number(buffer, (long*)&len, 2);
+	byte_len = decode_length(st, buffer, &len);
 	buffer += byte_len;
 
 	sv.len = len;
-	sv.name = field->name;
+	set_field(&sv, code);
 	sv.vt = SGE_LIST;
-	ud = cb(ud, &sv);
+	ud = st->cb(ud, &sv);
+
 	for (; i < len; ++i) {
-		offset = decode_string_ex(field, ud, buffer, cb, i);
+		offset = sge_decode_dict(code, ud, buffer, st, i);
 		buffer += offset;
 		byte_len += offset;
 	}
@@ -306,59 +447,227 @@ decode_string_list(const sge_field* field, void* ud, const uint8_t* buffer, fiel
 	return byte_len;
 }
 
-static int
-encode_dict(const sge_field* field, const void* ud, uint8_t* buffer, field_get cb) {
-	return sge_encode_dict(field, ud, buffer, cb, -1);
+#define PRESENCE_FIELDS	64
+
+// what the getter gave for a field of a block with a presence bitmap, kept until the bitmap is written
+typedef struct {
+	const void* ptr;
+	size_t len;
+	long number;
+} sge_field_value;
+
+// a number is at its default when it is 0 at its width, a string or list when it is empty, a custom field when unset;
+// these are the values sge_decode gives a field it finds no bytes for
+static inline int
+field_is_default(const sge_field_code* code, const sge_field_value* v) {
+	switch (code->opcode) {
+		case SGE_OP_NUMBER:
+			return sign_extend(v->number, code->width) == 0;
+		case SGE_OP_CUSTOM:
+			return NULL == v->ptr;
+		default:
+			return v->len == 0;
+	}
 }
 
-static int
-decode_dict(const sge_field* field, void* ud, const uint8_t* buffer, field_set cb) {
-	return sge_decode_dict(field, ud, buffer, cb, -1);
+// a field after its bit is set: the bytes the dense encoding has, a custom field without its flag byte
+static void
+encode_value(const sge_field_code* code, const sge_field_value* v, sge_encode_state* st) {
+	size_t idx;
+
+	switch (code->opcode) {
+		case SGE_OP_NUMBER:
+			encode_integer(st, v->number, code->width);
+			return;
+		case SGE_OP_STRING:
+			encode_length(st, v->len);
+			if (v->ptr) {
+				write_bytes(st, v->ptr, v->len);
+			}
+			return;
+		case SGE_OP_CUSTOM:
+			sge_encode_block(code->block, v->ptr, st);
+			return;
+	}
+
+	encode_length(st, v->len);
+	for (idx = 0; idx < v->len; ++idx) {
+		switch (code->opcode) {
+			case SGE_OP_NUMBER_LIST:
+				encode_number(code, v->ptr, st, idx);
+				break;
+			case SGE_OP_STRING_LIST:
+				encode_string_ex(code, v->ptr, st, idx);
+				break;
+			default:
+				sge_encode_dict(code, v->ptr, st, idx);
+				break;
+		}
+	}
 }
 
-static int
-encode_dict_list(const sge_field* field, const void* ud, uint8_t* buffer, field_get cb) {
-	size_t idx = 0, offset = 0;
-	sge_value sv = NEW_SGE_VALUE;
-	uint8_t *start = buffer;
+// every getter of the block is called before a field is written, so the bitmap goes out first and is never patched,
+// which a sink that already flushed it couldn't do
+static void
+encode_presence_block(const sge_block* block, const void* ud, sge_encode_state* st) {
+	sge_field_value inline_values[PRESENCE_FIELDS];
+	sge_field_value *values = inline_values, *v;
+	const sge_field_code *code = block->codes;
+	const sge_field_code *end = code + block->size;
+	sge_value sv;
+	uint8_t bits = 0;
+
+	if (block->size > PRESENCE_FIELDS) {
+		values = sge_malloc(sizeof(sge_field_value) * block->size);
+		if (NULL == values) {
+			st->err = SGE_ERR;
+			return;
+		}
+	}
 
-	sv.name = field->name;
-	cb(ud, &sv);
+	for (v = values; code < end; ++code, ++v) {
+		sv = (sge_value)NEW_SGE_VALUE;
+		set_field(&sv, code);
+		v->number = 0;
+		if (code->opcode == SGE_OP_NUMBER) {
+			sv.ptr = &v->number;
+		}
+		st->cb(ud, &sv);
+		v->ptr = sv.ptr;
+		v->len = sv.len;
+		if (!field_is_default(code, v)) {
+			bits |= 1 << (code->ordinal & 7);
+		}
+		if ((code->ordinal & 7) == 7 || code + 1 == end) {
+			write_byte(st, bits);
+			bits = 0;
+		}
+	}
+
+	for (code = block->codes, v = values; code < end; ++code, ++v) {
+		if (!field_is_default(code, v)) {
+			encode_value(code, v, st);
+		}
+	}
+	if (values != inline_values) {
+		sge_free(values);
+	}
+}
 
-	*buffer = (sv.len >> 8) & 0xff;
-	*(buffer + 1) = sv.len & 0xff;
-	buffer += 2;
+// field program interpreter, one switch dispatch per field
+static void
+sge_encode_block(const sge_block* block, const void* ud, sge_encode_state* st) {
+	const sge_field_code *code = block->codes;
+	const sge_field_code *end = code + block->size;
 
-	for (; idx < sv.len; ++idx) {
-		offset = sge_encode_dict(field, sv.ptr, buffer, cb, idx);
-		buffer += offset;
+	if (st->presence) {
+		encode_presence_block(block, ud, st);
+		return;
+	}
+	for (; code < end; ++code) {
+		switch (code->opcode) {
+			case SGE_OP_NUMBER:
+				encode_number(code, ud, st, -1);
+				break;
+			case SGE_OP_NUMBER_LIST:
+				encode_number_list(code, ud, st);
+				break;
+			case SGE_OP_STRING:
+				encode_string_ex(code, ud, st, -1);
+				break;
+			case SGE_OP_STRING_LIST:
+				encode_string_list(code, ud, st);
+				break;
+			case SGE_OP_CUSTOM:
+				sge_encode_dict(code, ud, st, -1);
+				break;
+			case SGE_OP_CUSTOM_LIST:
+				encode_dict_list(code, ud, st);
+				break;
+		}
 	}
+}
 
-	return buffer - start;
+static inline int
+decode_field(const sge_field_code* code, void* ud, const uint8_t* buffer, const sge_decode_state* st) {
+	switch (code->opcode) {
+		case SGE_OP_NUMBER:
+			return decode_number(code, ud, buffer, st, -1);
+		case SGE_OP_NUMBER_LIST:
+			return decode_number_list(code, ud, buffer, st);
+		case SGE_OP_STRING:
+			return decode_string_ex(code, ud, buffer, st, -1);
+		case SGE_OP_STRING_LIST:
+			return decode_string_list(code, ud, buffer, st);
+		case SGE_OP_CUSTOM:
+			return sge_decode_dict(code, ud, buffer, st, -1);
+		case SGE_OP_CUSTOM_LIST:
+			return decode_dict_list(code, ud, buffer, st);
+	}
+	return 0;
 }
 
-static int
-decode_dict_list(const sge_field* field, void* ud, const uint8_t* buffer, field_set cb) {
-	size_t len = 0, i = 0;
-	size_t offset = 0, byte_len;
+// a field whose bytes are there, behind a bitmap a custom field has no flag byte
+static inline int
+decode_present_field(const sge_field_code* code, void* ud, const uint8_t* buffer, const sge_decode_state* st) {
+	if (code->opcode == SGE_OP_CUSTOM && st->presence) {
+		return decode_dict_body(code, ud, buffer, st, -1);
+	}
+	return decode_field(code, ud, buffer, st);
+}
+
+// the calls sge_decode makes for a field written at its default: a 0 for a number, an empty list, none for an empty
+// string or an unset custom field
+static void
+decode_default(const sge_field_code* code, void* ud, const sge_decode_state* st) {
 	sge_value sv = NEW_SGE_VALUE;
 
-	len = ((*buffer << 8) & 0xff00) | (*(buffer + 1) & 0xff);
-	buffer += 2;
-	byte_len = 2;
+	switch (code->opcode) {
+		case SGE_OP_NUMBER:
+			sge_set_number(ud, st->cb, code, 0, -1);
+			break;
+		case SGE_OP_NUMBER_LIST:
+		case SGE_OP_STRING_LIST:
+		case SGE_OP_CUSTOM_LIST:
+			set_field(&sv, code);
+			sv.vt = SGE_LIST;
+			st->cb(ud, &sv);
+			break;
+	}
+}
 
-	sv.len = len;
-	sv.name = field->name;
-	sv.vt = SGE_LIST;
-	ud = cb(ud, &sv);
+static int
+decode_presence_block(const sge_block *block, void *ud, const uint8_t *buffer, const sge_decode_state* st) {
+	const sge_field_code *code = block->codes;
+	const sge_field_code *end = code + block->size;
+	const uint8_t *bitmap = buffer;
+
+	buffer += BITMAP_SIZE(block);
+	for (; code < end; ++code) {
+		if (FIELD_PRESENT(bitmap, code->ordinal)) {
+			buffer += decode_present_field(code, ud, buffer, st);
+		} else if (st->defaults == SGE_DEFAULTS_FILL) {
+			decode_default(code, ud, st);
+		}
+	}
 
-	for (; i < len; ++i) {
-		offset = sge_decode_dict(field, ud, buffer, cb, i);
-		buffer += offset;
-		byte_len += offset;
+	return buffer - bitmap;
+}
+
+static int
+sge_decode_block(const sge_block *block, void *ud, const uint8_t *buffer, const sge_decode_state* st) {
+	const sge_field_code *code = block->codes;
+	const sge_field_code *end = code + block->size;
+	const uint8_t *start = buffer;
+
+	if (st->presence) {
+		return decode_presence_block(block, ud, buffer, st);
+	}
+	for (; code < end; ++code) {
+		buffer += decode_field(code, ud, buffer, st);
 	}
 
-	return byte_len;
+	return buffer - start;
 }
 
 static void
@@ -373,85 +682,35 @@ print_custom_field(const sge_field* field, int level) {
 	printf("%*.sname: %s, type: %s\n", level * 4, " ", field->name, type);
 }
 
-static const sge_field_operations number8_ops = {
-	.encode=encode_number8,
-	.decode=decode_number8,
-	.print=print_field
-};
-
-static const sge_field_operations number16_ops = {
-	.encode=encode_number16,
-	.decode=decode_number16,
-	.print=print_field
-};
-
-static const sge_field_operations number32_ops = {
-	.encode=encode_number32,
-	.decode=decode_number32,
-	.print=print_field
-};
-
-static const sge_field_operations number8_list_ops = {
-	.encode=encode_number8_list,
-	.decode=decode_number8_list,
-	.print=print_field
-};
-
-static const sge_field_operations number16_list_ops = {
-	.encode=encode_number16_list,
-	.decode=decode_number16_list,
-	.print=print_field
-};
-
-static const sge_field_operations number32_list_ops = {
-	.encode=encode_number32_list,
-	.decode=decode_number32_list,
-	.print=print_field
-};
-
-static const sge_field_operations string_ops = {
-	.encode=encode_string,
-	.decode=decode_string,
-	.print=print_field
-};
-
-static const sge_field_operations string_list_ops = {
-	.encode=encode_string_list,
-	.decode=decode_string_list,
-	.print=print_field
-};
-
-static const sge_field_operations custom_ops = {
-	.encode=encode_dict,
-	.decode=decode_dict,
-	.print=print_custom_field
+static const sge_field_type field_type_table[] = {
+	{"number", 6, SGE_OP_NUMBER, 4, print_field},
+	{"number[]", 8, SGE_OP_NUMBER_LIST, 4, print_field},
+	{"number8", 7, SGE_OP_NUMBER, 1, print_field},
+	{"number16", 8, SGE_OP_NUMBER, 2, print_field},
+	{"number32", 8, SGE_OP_NUMBER, 4, print_field},
+	{"number8[]", 9, SGE_OP_NUMBER_LIST, 1, print_field},
+	{"number16[]", 10, SGE_OP_NUMBER_LIST, 2, print_field},
+	{"number32[]", 10, SGE_OP_NUMBER_LIST, 4, print_field},
+	{"string", 6, SGE_OP_STRING, 0, print_field},
+	{"string[]", 8, SGE_OP_STRING_LIST, 0, print_field},
+	{NULL, 0, 0, 0, NULL},
+	{"%s", 2, SGE_OP_CUSTOM, 0, print_custom_field},
+	{"%s[]", 4, SGE_OP_CUSTOM_LIST, 0, print_custom_field},
 };
 
-static const sge_field_operations custom_list_ops = {
-	.encode=encode_dict_list,
-	.decode=decode_dict_list,
-	.print=print_custom_field
+// the context behind the functions without a ctx argument
+static sge_context protocol = {
+	.init=0,
+	.version=SGE_VERSION_1
 };
 
-static const sge_field_type field_type_table[] = {
-	{"number", 6, &number32_ops},
-	{"number[]", 8, &number32_list_ops},
-	{"number8", 7, &number8_ops},
-	{"number16", 8, &number16_ops},
-	{"number32", 8, &number32_ops},
-	{"number8[]", 9, &number8_list_ops},
-	{"number16[]", 10, &number16_list_ops},
-	{"number32[]", 10, &number32_list_ops},
-	{"string", 6, &string_ops},
-	{"string[]", 8, &string_list_ops},
-	{NULL, 0, NULL},
-	{"%s", 2, &custom_ops},
-	{"%s[]", 4, &custom_list_ops},
-};
+// SGE_ERR details, per thread so a shared context never carries another call's message
+static __thread char error_buffer[SGE_ERROR_SIZE];
 
-static sge_proto protocol = {
-	.init=0
-};
+char*
+sge_error_buffer() {
+	return error_buffer;
+}
 
 static uint32_t
 hash_string(const void* s, size_t s_len) {
@@ -468,52 +727,37 @@ hash_string(const void* s, size_t s_len) {
 	return hash % SLOT_SIZE;
 }
 
-static uint32_t
-hash_number(const void* d, size_t len) {
-	return *(uint32_t*)d % SLOT_SIZE;
-}
-
 static int
 compare_string(const void* ptr, const void* key, size_t keylen) {
 	return strncmp(ptr, key, keylen);
 }
 
-static int
-compare_number(const void* ptr, const void* key, size_t keylen) {
-	uint32_t i = *(uint32_t*)key;
-	uint32_t j = *(uint32_t*)ptr;
-	return i != j;
-}
-
 
 static int
-init_protocol() {
-	protocol.ht_idx = sge_table_alloc();
-	protocol.ht_name = sge_table_alloc();
-	LIST_INIT(&(protocol.block_head));
-	LIST_INIT(&(protocol.unfinished_fields));
-	sge_table_init(protocol.ht_idx, hash_number, compare_number);
-	sge_table_init(protocol.ht_name, hash_string, compare_string);
-	memset(protocol.err, 0, sizeof(protocol.err));
-	protocol.init = 1;
+init_protocol(sge_context* ctx) {
+	ctx->ht_name = sge_table_alloc();
+	LIST_INIT(&(ctx->block_head));
+	LIST_INIT(&(ctx->unfinished_fields));
+	sge_table_init(ctx->ht_name, hash_string, compare_string);
+	ctx->init = 1;
 	return SGE_OK;
 }
 
 static int
-parse_text(const char* text) {
-	if (protocol.init == 0) {
-		init_protocol();
+parse_text(sge_context* ctx, const char* text) {
+	if (ctx->init == 0) {
+		init_protocol(ctx);
 	}
-	protocol.text.data = text;
-	protocol.text.len = strlen(text);
-	protocol.text.cursor = text;
-	protocol.text.lineno = 1;
+	ctx->text.data = text;
+	ctx->text.len = strlen(text);
+	ctx->text.cursor = text;
+	ctx->text.lineno = 1;
 
-	return sge_parse_protocol(&protocol);
+	return sge_parse_protocol(ctx);
 }
 
 int
-sge_get_block(const char* type, size_t type_len, sge_block** block) {
+sge_get_block(const sge_context* ctx, const char* type, size_t type_len, sge_block** block) {
 	int ret = 1;
 	size_t cmp_type_len;
 
@@ -523,12 +767,54 @@ sge_get_block(const char* type, size_t type_len, sge_block** block) {
 		ret = 2;
 	}
 
-	*block = (sge_block*)sge_table_get(protocol.ht_name, type, cmp_type_len);
+	*block = (sge_block*)sge_table_get(ctx->ht_name, type, cmp_type_len);
 	return ret;
 }
 
+// fill in the check of a frame whose header and body are buffer[2, st->cur)
+static void
+write_checksum(uint8_t* buffer, sge_encode_state* st, int integrity) {
+	size_t len = st->cur - buffer - 2;
+
+	switch (integrity) {
+		case SGE_INTEGRITY_NONE:
+			buffer[0] = buffer[1] = 0;
+			break;
+		case SGE_INTEGRITY_CRC32C:
+			buffer[0] = buffer[1] = 0;
+			write_number(st, sge_crc32c((const char*)buffer + 2, len), 4);
+			break;
+		default:
+			sge_encode_number(buffer, sge_crc16((const char*)buffer + 2, len), 2);
+			break;
+	}
+}
+
+static int
+verify_checksum(const uint8_t* buffer, size_t len, int integrity) {
+	long value;
+	uint32_t crc32;
+
+	switch (integrity) {
+		case SGE_INTEGRITY_NONE:
+			return SGE_OK;
+		case SGE_INTEGRITY_CRC32C:
+			sge_decode_number(buffer + 2 + len, &value, 4);
+			crc32 = sge_crc32c((const char*)buffer + 2, len);
+			return ((uint32_t)value == crc32) ? SGE_OK : SGE_ERR;
+		default:
+			sge_decode_number(buffer, &value, 2);
+			return ((uint16_t)value == sge_crc16((const char*)buffer + 2, len)) ? SGE_OK : SGE_ERR;
+	}
+}
+
+const sge_context*
+sge_get_protocol() {
+	return &protocol;
+}
+
 int
-sge_add_field(const char* field_name, size_t field_name_len, const char* type, size_t type_len, sge_field** field) {
+sge_add_field(const sge_context* ctx, const char* field_name, size_t field_name_len, const char* type, size_t type_len, sge_field** field) {
 	const sge_field_type* field_type = NULL;
 	const sge_field_type* p = field_type_table;
 	sge_block* block = NULL;
@@ -544,7 +830,7 @@ sge_add_field(const char* field_name, size_t field_name_len, const char* type, s
 		}
 	}
 	if (NULL == field_type) {
-		offset = sge_get_block(type, type_len, &block);
+		offset = sge_get_block(ctx, type, type_len, &block);
 		field_type = p + offset;
 		if (!block) {
 			ret = SGE_ERR;
@@ -556,28 +842,69 @@ sge_add_field(const char* field_name, size_t field_name_len, const char* type, s
 }
 
 
+static void
+clear_context(sge_context* ctx) {
+	sge_block* block;
+	sge_list* pb, *pb_next;
+
+	if (ctx->init == 0) {
+		return;
+	}
+
+	for (pb = ctx->block_head.next; !LIST_EMPTY(&ctx->block_head); ) {
+		pb_next = pb->next;
+		block = LIST_DATA(pb, sge_block, head);
+		sge_destroy_block(block);
+		pb = pb_next;
+	}
+
+	sge_table_destroy(ctx->ht_name);
+	sge_index_destroy(&ctx->index);
+	ctx->init = 0;
+}
+
 // export
+sge_context*
+sge_ctx_new(void) {
+	sge_context* ctx = sge_malloc(sizeof(sge_context));
+	if (NULL == ctx) {
+		return NULL;
+	}
+	memset(ctx, 0, sizeof(sge_context));
+	ctx->version = SGE_VERSION_1;
+	return ctx;
+}
+
+void
+sge_ctx_free(sge_context* ctx) {
+	if (NULL == ctx) {
+		return;
+	}
+	clear_context(ctx);
+	sge_free(ctx);
+}
+
 int
-sge_parse(const char* text) {
+sge_ctx_parse(sge_context* ctx, const char* text) {
 	int ret;
-	if (NULL == text) {
+	if (NULL == ctx || NULL == text) {
 		return INVALID_PARAM;
 	}
-	ret = parse_text(text);
+	ret = parse_text(ctx, text);
 	if (SGE_OK != ret) {
-		sge_destroy(0);
+		clear_context(ctx);
 	}
 	return ret;
 }
 
 int
-sge_parse_file(const char* file) {
+sge_ctx_parse_file(sge_context* ctx, const char* file) {
 	int ret;
 	long len = 0;
 	FILE *fp = NULL;
 	char *buffer = NULL;
 
-	if (NULL == file) {
+	if (NULL == ctx || NULL == file) {
 		return INVALID_PARAM;
 	}
 
@@ -596,198 +923,2338 @@ sge_parse_file(const char* file) {
 	buffer[len] = '\0';
 	fclose(fp);
 
-	ret = parse_text(buffer);
+	ret = parse_text(ctx, buffer);
 	sge_free(buffer);
 	if (SGE_OK != ret) {
-		sge_destroy(0);
+		clear_context(ctx);
 	}
 	return ret;
 }
 
 int
-sge_encode(const char* name, const void *ud, char* buffer, field_get cb) {
+sge_parse(const char* text) {
+	return sge_ctx_parse(&protocol, text);
+}
+
+int
+sge_parse_file(const char* file) {
+	return sge_ctx_parse_file(&protocol, file);
+}
+
+int
+sge_ctx_set_option(sge_context* ctx, int option, int value) {
+	if (NULL == ctx) {
+		return INVALID_PARAM;
+	}
+
+	switch (option) {
+		case SGE_OPT_INTEGRITY:
+			if (value < SGE_INTEGRITY_CRC16 || value > SGE_INTEGRITY_CRC32C) {
+				return INVALID_PARAM;
+			}
+			ctx->integrity = value;
+			return SGE_OK;
+		case SGE_OPT_VERSION:
+			if (value < SGE_VERSION_1 || value > SGE_VERSION_3) {
+				return INVALID_PARAM;
+			}
+			ctx->version = value;
+			return SGE_OK;
+		case SGE_OPT_PRESENCE:
+			if (value != SGE_PRESENCE_NONE && value != SGE_PRESENCE_BITMAP) {
+				return INVALID_PARAM;
+			}
+			ctx->presence = value;
+			return SGE_OK;
+		case SGE_OPT_DEFAULTS:
+			if (value != SGE_DEFAULTS_FILL && value != SGE_DEFAULTS_SKIP) {
+				return INVALID_PARAM;
+			}
+			ctx->defaults = value;
+			return SGE_OK;
+		default:
+			return INVALID_PARAM;
+	}
+}
+
+int
+sge_set_option(int option, int value) {
+	return sge_ctx_set_option(&protocol, option, value);
+}
+
+int
+sge_ctx_bind_fields(sge_context* ctx, sge_bind_fn bind, void* ud) {
+	sge_list* iter;
+	sge_block* block;
+	sge_field_code* code;
+	uint32_t i;
+
+	if (NULL == ctx || NULL == bind) {
+		return INVALID_PARAM;
+	}
+	if (ctx->init == 0) {
+		return NOT_SCHEME;
+	}
+
+	LIST_FOREACH(iter, &ctx->block_head) {
+		block = LIST_DATA(iter, sge_block, head);
+		if (NULL == block->codes) {
+			continue;
+		}
+		for (i = 0, code = block->codes; i < block->size; ++i, ++code) {
+			code->slot = bind(code->slot, code->name, code->name_len, ud);
+		}
+	}
+	return SGE_OK;
+}
+
+int
+sge_bind_fields(sge_bind_fn bind, void* ud) {
+	return sge_ctx_bind_fields(&protocol, bind, ud);
+}
+
+static void
+init_encode_state(const sge_context* ctx, sge_encode_state* st, field_get cb, uint8_t* buffer, size_t capacity) {
+	st->cb = cb;
+	st->version = ctx->version;
+	st->integrity = ctx->integrity;
+	st->presence = ctx->presence;
+	st->err = SGE_OK;
+	st->cur = buffer;
+	st->end = buffer ? buffer + capacity : buffer;
+	st->overflow = 0;
+	st->sink = NULL;
+	st->flushed = 0;
+	st->crc_skip = 2;
+	st->crc = 0;
+}
+
+static sge_block*
+find_block(const sge_context* ctx, const char* name) {
+	sge_block *block = sge_index_name(&ctx->index, name);
+	if (NULL == block) {
+		SET_ERROR("can't found protocol: %s", name);
+	}
+	return block;
+}
+
+static inline uint8_t
+version_char(const sge_context* ctx) {
+	return ctx->presence ? SGE_PRESENCE_CHAR(ctx->version) : SGE_VERSION_CHAR(ctx->version);
+}
+
+static void
+encode_body(const sge_context* ctx, const sge_block* block, const void* ud, sge_encode_state* st) {
+	write_number(st, 0, 2);
+	write_byte(st, SGE_INTEGRITY_CHAR(ctx->integrity));
+	write_byte(st, version_char(ctx));
+	write_number(st, block->idx, 2);
+	sge_encode_block(block, ud, st);
+}
+
+static int
+encode_block_frame(const sge_context* ctx, const sge_block* block, const void *ud, char* buffer, size_t capacity, field_get cb) {
+	sge_encode_state st;
+
+	init_encode_state(ctx, &st, cb, (uint8_t*)buffer, capacity);
+	encode_body(ctx, block, ud, &st);
+	if (st.err != SGE_OK) {
+		return st.err;
+	}
+	if (st.overflow) {
+		// only the size is wanted, the trailer is all that's left to count
+		st.overflow += (ctx->integrity == SGE_INTEGRITY_CRC32C) ? 4 : 0;
+	} else {
+		write_checksum((uint8_t*)buffer, &st, ctx->integrity);
+	}
+	if ((size_t)(st.cur - (uint8_t*)buffer) + st.overflow > INT_MAX) {
+		return LENGTH_OVERFLOW;
+	}
+	return (st.cur - (uint8_t*)buffer) + st.overflow;
+}
+
+static int
+encode_frame(const sge_context* ctx, const char* name, const void *ud, char* buffer, size_t capacity, field_get cb) {
+	sge_block *block;
+
+	if (NULL == ctx || NULL == name || NULL == ud || (NULL == buffer && capacity) || NULL == cb) {
+		return INVALID_PARAM;
+	}
+
+	if (ctx->init == 0) {
+		return NOT_SCHEME;
+	}
+
+	block = find_block(ctx, name);
+	if (NULL == block) {
+		return SGE_ERR;
+	}
+	return encode_block_frame(ctx, block, ud, buffer, capacity, cb);
+}
+
+int
+sge_ctx_encode(const sge_context* ctx, const char* name, const void *ud, char* buffer, field_get cb) {
+	return encode_frame(ctx, name, ud, buffer, INT_MAX, cb);
+}
+
+int
+sge_ctx_encode_n(const sge_context* ctx, const char* name, const void *ud, char* buffer, size_t capacity, field_get cb) {
+	return encode_frame(ctx, name, ud, buffer, capacity, cb);
+}
+
+int
+sge_ctx_encoded_size(const sge_context* ctx, const char* name, const void *ud, field_get cb) {
+	return encode_frame(ctx, name, ud, NULL, 0, cb);
+}
+
+sge_block_handle
+sge_ctx_block(const sge_context* ctx, const char* name) {
+	if (NULL == ctx || NULL == name || ctx->init == 0) {
+		return NULL;
+	}
+	return find_block(ctx, name);
+}
+
+sge_block_handle
+sge_ctx_block_next(const sge_context* ctx, sge_block_handle prev) {
+	const sge_list* iter;
+	sge_block* block;
+
+	if (NULL == ctx || ctx->init == 0) {
+		return NULL;
+	}
+	iter = prev ? prev->head.next : ctx->block_head.next;
+	for (; iter != &ctx->block_head; iter = iter->next) {
+		block = LIST_DATA(iter, sge_block, head);
+		// blocks of a parse that failed never got compiled
+		if (block->codes) {
+			return block;
+		}
+	}
+	return NULL;
+}
+
+const char*
+sge_block_name(sge_block_handle block) {
+	return block ? block->name : NULL;
+}
+
+int
+sge_block_field(sge_block_handle block, uint32_t ordinal, sge_value* field) {
+	const sge_field_code* code;
+
+	if (NULL == block || NULL == field || ordinal >= block->size) {
+		return INVALID_PARAM;
+	}
+
+	code = block->codes + ordinal;
+	*field = (sge_value)NEW_SGE_VALUE;
+	set_field(field, code);
+	field->len = code->name_len;
+	field->ptr = code->block;
+	switch (code->opcode) {
+		case SGE_OP_NUMBER:
+			field->vt = SGE_NUMBER;
+			break;
+		case SGE_OP_STRING:
+			field->vt = SGE_STRING;
+			break;
+		case SGE_OP_CUSTOM:
+			field->vt = SGE_DICT;
+			break;
+		default:
+			field->vt = SGE_LIST;
+			break;
+	}
+	return SGE_OK;
+}
+
+int
+sge_encode_h(sge_block_handle block, const void *ud, char* buffer, size_t capacity, field_get cb) {
+	if (NULL == block || NULL == ud || (NULL == buffer && capacity) || NULL == cb) {
+		return INVALID_PARAM;
+	}
+	return encode_block_frame(block->ctx, block, ud, buffer, capacity, cb);
+}
+
+int
+sge_encode(const char* name, const void *ud, char* buffer, field_get cb) {
+	return encode_frame(&protocol, name, ud, buffer, INT_MAX, cb);
+}
+
+int
+sge_encode_n(const char* name, const void *ud, char* buffer, size_t capacity, field_get cb) {
+	return encode_frame(&protocol, name, ud, buffer, capacity, cb);
+}
+
+sge_block_handle
+sge_block_find(const char* name) {
+	return sge_ctx_block(&protocol, name);
+}
+
+sge_block_handle
+sge_block_next(sge_block_handle prev) {
+	return sge_ctx_block_next(&protocol, prev);
+}
+
+int
+sge_encoded_size(const char* name, const void *ud, field_get cb) {
+	return encode_frame(&protocol, name, ud, NULL, 0, cb);
+}
+
+// the whole frame through st->sink, the CRC-16 of the frame is left in st->crc
+static void
+encode_sink_frame(const sge_context* ctx, const sge_block* block, const void* ud, sge_encode_state* st) {
+	sge_sink* sink = st->sink;
+
+	encode_body(ctx, block, ud, st);
+	if (st->err == SGE_OK && ctx->integrity == SGE_INTEGRITY_CRC32C) {
+		st->crc = sge_crc32c_update(st->crc, sink->buffer + st->crc_skip, st->cur - (uint8_t*)sink->buffer - st->crc_skip);
+		// keep the trailer itself out of the running check
+		st->crc_skip = st->cur - (uint8_t*)sink->buffer;
+		write_number(st, st->crc, 4);
+	}
+	if (st->err == SGE_OK) {
+		flush_sink(st);
+	}
+}
+
+int
+sge_ctx_encode_sink(const sge_context* ctx, const char* name, const void *ud, sge_sink* sink, field_get cb) {
 	sge_block *block;
+	sge_encode_state st;
+
+	if (NULL == ctx || NULL == name || NULL == ud || NULL == sink || NULL == sink->buffer || NULL == sink->flush || NULL == cb) {
+		return INVALID_PARAM;
+	}
+	if (sink->size < SGE_SINK_MIN_SIZE) {
+		return INVALID_PARAM;
+	}
+
+	if (ctx->init == 0) {
+		return NOT_SCHEME;
+	}
+
+	// the CRC-16 sits in front of the frame and would be known only after it was flushed
+	if (ctx->integrity == SGE_INTEGRITY_CRC16) {
+		SET_ERROR("streaming encode needs SGE_INTEGRITY_NONE or SGE_INTEGRITY_CRC32C");
+		return SGE_ERR;
+	}
+
+	block = find_block(ctx, name);
+	if (NULL == block) {
+		return SGE_ERR;
+	}
+
+	init_encode_state(ctx, &st, cb, (uint8_t*)sink->buffer, sink->size);
+	st.sink = sink;
+	encode_sink_frame(ctx, block, ud, &st);
+	if (st.err != SGE_OK) {
+		return st.err;
+	}
+	if (st.flushed > INT_MAX) {
+		return LENGTH_OVERFLOW;
+	}
+	return st.flushed;
+}
+
+// bytes written so far, including those only counted
+#define WRITTEN(st, buffer)	((size_t)((st)->cur - (uint8_t*)(buffer)) + (st)->overflow)
+
+int
+sge_encode_sink(const char* name, const void *ud, sge_sink* sink, field_get cb) {
+	return sge_ctx_encode_sink(&protocol, name, ud, sink, cb);
+}
+
+// packed output of sge_encode_packed. cur is NULL once something didn't fit, after that the size is only counted
+typedef struct {
+	char* out;
+	char* cur;
+	char* end;
+	size_t size;
+	int integrity;
+	int crc_known;
 	uint16_t crc;
-	uint32_t keylen;
-	size_t offset = 0;
-	uint8_t *p_buffer = (uint8_t *)buffer;
+} sge_packer;
+
+static void
+packer_emit(sge_packer* pk, const char* bytes, size_t len) {
+	if (pk->cur && (size_t)(pk->end - pk->cur) >= len) {
+		memcpy(pk->cur, bytes, len);
+		pk->cur += len;
+	} else {
+		pk->cur = NULL;
+	}
+	pk->size += len;
+}
+
+// chunks come in whole groups, only the last one may end in a partial group
+static int
+packer_flush(sge_sink* sink, const char* data, size_t len) {
+	sge_packer* pk = (sge_packer*)sink->ud;
+	char tmp[SGE_PACK_CHUNK_SIZE + SGE_PACK_CHUNK_SIZE / 8 + 1];
+	char* stop;
+	size_t i, n;
+
+	if (pk->size == 0 && pk->integrity == SGE_INTEGRITY_CRC16 && pk->crc_known) {
+		sge_encode_number((uint8_t*)sink->buffer, pk->crc, 2);
+	} else if (pk->size == 0 && pk->integrity == SGE_INTEGRITY_CRC16) {
+		// group 0 keeps two slots for the check, filled in by packer_finish
+		n = len < 8 ? len : 8;
+		tmp[0] = 0;
+		tmp[1] = tmp[2] = 0;
+		for (i = 2, stop = tmp + 3; i < n; ++i) {
+			if (data[i]) {
+				tmp[0] |= 1 << i;
+				*stop++ = data[i];
+			}
+		}
+		packer_emit(pk, tmp, stop - tmp);
+		data += n;
+		len -= n;
+	}
+
+	if (pk->cur && (size_t)(pk->end - pk->cur) >= len + (len + 7) / 8) {
+		stop = sge_pack_span(data, data + len, pk->cur);
+		pk->size += stop - pk->cur;
+		pk->cur = stop;
+	} else {
+		// near the end of the buffer the kernel's whole group stores could run past it
+		packer_emit(pk, tmp, sge_pack_span(data, data + len, tmp) - tmp);
+	}
+	return SGE_OK;
+}
+
+// puts the non zero bytes of the CRC-16 into the slots of group 0, a zero byte closes its slot up
+static void
+packer_finish(sge_packer* pk, uint16_t crc) {
+	uint8_t check[2];
+	size_t kept = 0;
+
+	sge_encode_number(check, crc, 2);
+	if (check[0]) {
+		pk->out[0] |= 1;
+		pk->out[1 + kept++] = check[0];
+	}
+	if (check[1]) {
+		pk->out[0] |= 2;
+		pk->out[1 + kept++] = check[1];
+	}
+	if (kept < 2) {
+		memmove(pk->out + 1 + kept, pk->out + 3, pk->cur - (pk->out + 3));
+		pk->cur -= 2 - kept;
+	}
+}
+
+static int
+encode_block_packed(const sge_context* ctx, const sge_block* block, const void *ud, char* buffer, size_t capacity,
+	field_get cb, int crc_known, uint16_t crc) {
+	char chunk[SGE_PACK_CHUNK_SIZE];
+	sge_encode_state st;
+	sge_packer pk;
+	sge_sink sink;
+
+	pk.out = pk.cur = buffer;
+	pk.end = buffer + capacity;
+	pk.size = 0;
+	pk.integrity = ctx->integrity;
+	pk.crc_known = crc_known;
+	pk.crc = crc;
+	sink.buffer = chunk;
+	sink.size = sizeof(chunk);
+	sink.flush = packer_flush;
+	sink.ud = &pk;
+
+	init_encode_state(ctx, &st, cb, (uint8_t*)chunk, sizeof(chunk));
+	st.sink = &sink;
+	encode_sink_frame(ctx, block, ud, &st);
+	if (st.err != SGE_OK) {
+		return st.err;
+	}
+	if (pk.integrity == SGE_INTEGRITY_CRC16 && !crc_known) {
+		if (pk.cur) {
+			packer_finish(&pk, st.crc);
+		}
+		pk.size -= !(st.crc >> 8) + !(st.crc & 0xff);
+		// the slots of a zero check byte took room the frame doesn't need, again with the check known
+		if (NULL == pk.cur && buffer && pk.size <= capacity) {
+			return encode_block_packed(ctx, block, ud, buffer, capacity, cb, 1, st.crc);
+		}
+	}
+	if (pk.size > INT_MAX) {
+		return LENGTH_OVERFLOW;
+	}
+	return pk.size;
+}
+
+int
+sge_ctx_encode_packed(const sge_context* ctx, const char* name, const void *ud, char* buffer, size_t capacity, field_get cb) {
+	sge_block *block;
+
+	if (NULL == ctx || NULL == name || NULL == ud || (NULL == buffer && capacity) || NULL == cb) {
+		return INVALID_PARAM;
+	}
+
+	if (ctx->init == 0) {
+		return NOT_SCHEME;
+	}
+
+	block = find_block(ctx, name);
+	if (NULL == block) {
+		return SGE_ERR;
+	}
+	return encode_block_packed(ctx, block, ud, buffer, capacity, cb, 0, 0);
+}
+
+int
+sge_encode_packed(const char* name, const void *ud, char* buffer, size_t capacity, field_get cb) {
+	return sge_ctx_encode_packed(&protocol, name, ud, buffer, capacity, cb);
+}
+
+int
+sge_ctx_encode_batch(const sge_context* ctx, const sge_batch_item* items, size_t count, char* buffer, size_t capacity, field_get cb) {
+	size_t i, start;
+	uint8_t *len_at, *entries_at;
+	sge_block *block;
+	sge_encode_state st;
+
+	if (NULL == ctx || (NULL == items && count) || (NULL == buffer && capacity) || NULL == cb || count > UINT32_MAX) {
+		return INVALID_PARAM;
+	}
+
+	if (ctx->init == 0) {
+		return NOT_SCHEME;
+	}
+
+	init_encode_state(ctx, &st, cb, (uint8_t*)buffer, capacity);
+	write_number(&st, 0, 2);
+	write_byte(&st, SGE_INTEGRITY_CHAR(ctx->integrity));
+	write_byte(&st, SGE_BATCH_CHAR);
+	write_byte(&st, version_char(ctx));
+	write_number(&st, count, 4);
+	entries_at = st.cur;
+	write_number(&st, 0, 4);
+
+	for (i = 0; i < count; ++i) {
+		if (NULL == items[i].name || NULL == items[i].ud) {
+			return INVALID_PARAM;
+		}
+		block = find_block(ctx, items[i].name);
+		if (NULL == block) {
+			return SGE_ERR;
+		}
+		write_number(&st, block->idx, 2);
+		len_at = st.cur;
+		write_number(&st, 0, 4);
+		start = WRITTEN(&st, buffer);
+		sge_encode_block(block, items[i].ud, &st);
+		if (WRITTEN(&st, buffer) - start > UINT32_MAX) {
+			return LENGTH_OVERFLOW;
+		}
+		if (st.overflow == 0) {
+			sge_encode_number(len_at, WRITTEN(&st, buffer) - start, 4);
+		}
+	}
+	if (st.err != SGE_OK) {
+		return st.err;
+	}
+
+	if (WRITTEN(&st, buffer) - SGE_BATCH_HEADER_SIZE > UINT32_MAX) {
+		return LENGTH_OVERFLOW;
+	}
+	if (st.overflow) {
+		st.overflow += (ctx->integrity == SGE_INTEGRITY_CRC32C) ? 4 : 0;
+	} else {
+		sge_encode_number(entries_at, WRITTEN(&st, buffer) - SGE_BATCH_HEADER_SIZE, 4);
+		write_checksum((uint8_t*)buffer, &st, ctx->integrity);
+	}
+	if (WRITTEN(&st, buffer) > INT_MAX) {
+		return LENGTH_OVERFLOW;
+	}
+	return WRITTEN(&st, buffer);
+}
+
+int
+sge_encode_batch(const sge_batch_item* items, size_t count, char* buffer, size_t capacity, field_get cb) {
+	return sge_ctx_encode_batch(&protocol, items, count, buffer, capacity, cb);
+}
+
+int
+sge_ctx_encoded_bound(const sge_context* ctx, const char* name, size_t* bound) {
+	sge_block *block;
+	size_t body;
+
+	if (NULL == ctx || NULL == name || NULL == bound) {
+		return INVALID_PARAM;
+	}
+
+	if (ctx->init == 0) {
+		return NOT_SCHEME;
+	}
+
+	block = find_block(ctx, name);
+	if (NULL == block) {
+		return SGE_ERR;
+	}
+
+	body = (ctx->version == SGE_VERSION_2) ? block->varint_bound : block->fixed_bound;
+	if (body == SGE_UNBOUNDED) {
+		*bound = SGE_UNBOUNDED;
+	} else {
+		// with bitmaps a set custom field drops its flag byte, the bound keeps it
+		*bound = body + 6 + ((ctx->integrity == SGE_INTEGRITY_CRC32C) ? 4 : 0) + (ctx->presence ? block->bitmap_bound : 0);
+	}
+	return SGE_OK;
+}
+
+int
+sge_encoded_bound(const char* name, size_t* bound) {
+	return sge_ctx_encoded_bound(&protocol, name, bound);
+}
+
+// the version written in a header byte, presence tells whether the frame has bitmaps; out of range when it is neither
+static inline int
+header_version(uint8_t c, int* presence) {
+	*presence = c >= SGE_PRESENCE_CHAR(SGE_VERSION_1);
+	return *presence ? c - SGE_PRESENCE_CHAR(0) : c - SGE_VERSION_CHAR(0);
+}
+
+// the block a frame was encoded from and the state to decode it with, NULL with the error set when the header is wrong
+static sge_block*
+frame_block(const sge_context* ctx, const uint8_t* p, int* integrity, sge_decode_state* st) {
+	uint32_t proto_idx;
+	long l_proto_idx;
+	sge_block *block;
+
+	*integrity = p[2] - '0';
+	st->version = header_version(p[3], &st->presence);
+	st->defaults = ctx->defaults;
+	if (*integrity < SGE_INTEGRITY_CRC16 || *integrity > SGE_INTEGRITY_CRC32C ||
+		st->version < SGE_VERSION_1 || st->version > SGE_VERSION_3) {
+		SET_ERROR("bytes wrong format.");
+		return NULL;
+	}
+
+	sge_decode_number(p + 4, &l_proto_idx, 2);
+	proto_idx = (uint16_t)l_proto_idx;
+	block = sge_index_idx(&ctx->index, proto_idx);
+	if (NULL == block) {
+		SET_ERROR("can't found protocol: %d", proto_idx);
+	}
+	return block;
+}
+
+static const uint8_t* view_skip_block(const sge_block* block, const sge_decode_state* st, const uint8_t* p,
+	const uint8_t* end, int depth);
+
+int
+sge_ctx_decode(const sge_context* ctx, const char* buffer, void* ud, field_set cb) {
+	int integrity;
+	size_t byte_len;
+	sge_block *block = NULL;
+	sge_decode_state st;
+
+	if (NULL == ctx || NULL == buffer || NULL == ud || NULL == cb) {
+		return INVALID_PARAM;
+	}
+
+	if (ctx->init == 0) {
+		return NOT_SCHEME;
+	}
+
+	block = frame_block(ctx, (const uint8_t*)buffer, &integrity, &st);
+	if (NULL == block) {
+		return SGE_ERR;
+	}
+	st.cb = cb;
+	byte_len = sge_decode_block(block, ud, (const uint8_t*)buffer + 6, &st);
+	if (SGE_OK != verify_checksum((const uint8_t*)buffer, byte_len + 4, integrity)) {
+		SET_ERROR("invalid protocol");
+		return SGE_ERR;
+	}
+
+	return block->idx;
+}
+
+int
+sge_decode(const char* buffer, void* ud, field_set cb) {
+	return sge_ctx_decode(&protocol, buffer, ud, cb);
+}
+
+// the frame is skipped within len before it is decoded, so no callback gets bytes from outside of it; bytes after the
+// frame are left alone
+int
+sge_ctx_decode_n(const sge_context* ctx, const char* buffer, size_t len, void* ud, field_set cb) {
+	const uint8_t* body = (const uint8_t*)buffer + 6;
+	const uint8_t* p;
+	int integrity;
+	sge_block *block = NULL;
+	sge_decode_state st;
+
+	if (NULL == ctx || NULL == buffer || len < 6 || NULL == ud || NULL == cb) {
+		return INVALID_PARAM;
+	}
+
+	if (ctx->init == 0) {
+		return NOT_SCHEME;
+	}
+
+	block = frame_block(ctx, (const uint8_t*)buffer, &integrity, &st);
+	if (NULL == block) {
+		return SGE_ERR;
+	}
+	if (integrity == SGE_INTEGRITY_CRC32C && len < 10) {
+		return INVALID_PARAM;
+	}
+	p = view_skip_block(block, &st, body,
+		(const uint8_t*)buffer + len - (integrity == SGE_INTEGRITY_CRC32C ? 4 : 0), 0);
+	if (NULL == p) {
+		SET_ERROR("bytes wrong format.");
+		return SGE_ERR;
+	}
+	st.cb = cb;
+	sge_decode_block(block, ud, body, &st);
+	if (SGE_OK != verify_checksum((const uint8_t*)buffer, p - body + 4, integrity)) {
+		SET_ERROR("invalid protocol");
+		return SGE_ERR;
+	}
+
+	return block->idx;
+}
+
+int
+sge_decode_n(const char* buffer, size_t len, void* ud, field_set cb) {
+	return sge_ctx_decode_n(&protocol, buffer, len, ud, cb);
+}
+
+// checks a whole frame, batch or compressed frame of len bytes against the check its header names, needs no schema
+int
+sge_verify(const char* buffer, size_t len) {
+	int integrity, version, presence;
+	char kind;
+	size_t trailer;
+
+	if (NULL == buffer || len < 6) {
+		return INVALID_PARAM;
+	}
+
+	integrity = buffer[2] - '0';
+	kind = buffer[3];
+	version = header_version(kind, &presence);
+	if (integrity < SGE_INTEGRITY_CRC16 || integrity > SGE_INTEGRITY_CRC32C || ((version < SGE_VERSION_1 ||
+		version > SGE_VERSION_3) && kind != SGE_BATCH_CHAR && kind != SGE_STAGE_PACK_CHAR && kind != SGE_STAGE_LZ_CHAR)) {
+		SET_ERROR("bytes wrong format.");
+		return SGE_ERR;
+	}
+	trailer = (integrity == SGE_INTEGRITY_CRC32C) ? 4 : 0;
+	if (len < 6 + trailer) {
+		return INVALID_PARAM;
+	}
+	if (SGE_OK != verify_checksum((const uint8_t*)buffer, len - 2 - trailer, integrity)) {
+		SET_ERROR("invalid protocol");
+		return SGE_ERR;
+	}
+	return SGE_OK;
+}
+
+// header and check around a payload already at out + SGE_STAGE_HEADER_SIZE, returns the whole size
+static int
+write_stage(char* out, int integrity, char stage, size_t frame_len, size_t payload_len) {
+	uint8_t* p = (uint8_t*)out;
+	size_t len = SGE_STAGE_HEADER_SIZE - 2 + payload_len;
+
+	p[2] = SGE_INTEGRITY_CHAR(integrity);
+	p[3] = stage;
+	sge_encode_number(p + 4, frame_len, 4);
+	switch (integrity) {
+		case SGE_INTEGRITY_NONE:
+			p[0] = p[1] = 0;
+			break;
+		case SGE_INTEGRITY_CRC32C:
+			p[0] = p[1] = 0;
+			sge_encode_number(p + 2 + len, sge_crc32c((const char*)p + 2, len), 4);
+			len += 4;
+			break;
+		default:
+			sge_encode_number(p, sge_crc16((const char*)p + 2, len), 2);
+			break;
+	}
+	return len + 2;
+}
+
+// raw, zero packed or LZ, whichever is smallest: LZ is only tried on frames of SGE_STAGE_LZ_MIN_SIZE and up, and only
+// when the first SGE_STAGE_LZ_SAMPLE bytes shrink by an eighth and below their zero packed size; that size is
+// counted, not produced
+int
+sge_compress(const char* frame, size_t len, char* out) {
+	int integrity, lz;
+	size_t overhead, packed, sample, trial, best;
+	char* payload;
+
+	if (NULL == frame || NULL == out || len < 6 || len > INT32_MAX) {
+		return INVALID_PARAM;
+	}
+	integrity = frame[2] - '0';
+	if (integrity < SGE_INTEGRITY_CRC16 || integrity > SGE_INTEGRITY_CRC32C) {
+		SET_ERROR("bytes wrong format.");
+		return SGE_ERR;
+	}
+	if (len < SGE_STAGE_MIN_SIZE) {
+		memcpy(out, frame, len);
+		return len;
+	}
+
+	overhead = SGE_STAGE_HEADER_SIZE + ((integrity == SGE_INTEGRITY_CRC32C) ? 4 : 0);
+	payload = out + SGE_STAGE_HEADER_SIZE;
+	packed = sge_packed_size(frame, frame + len) + overhead;
+	best = (packed < len) ? packed : len;
+
+	if (len >= SGE_STAGE_LZ_MIN_SIZE && best > overhead + 1) {
+		sample = (len < SGE_STAGE_LZ_SAMPLE) ? len : SGE_STAGE_LZ_SAMPLE;
+		trial = sge_packed_size(frame, frame + sample);
+		lz = sge_lz_compress(frame, sample, payload, (trial < sample - sample / 8) ? trial : sample - sample / 8);
+		if (lz >= 0 && sample < len) {
+			lz = sge_lz_compress(frame, len, payload, best - overhead - 1);
+		}
+		if (lz >= 0 && lz + overhead < best) {
+			return write_stage(out, integrity, SGE_STAGE_LZ_CHAR, len, lz);
+		}
+	}
+
+	if (packed < len) {
+		return write_stage(out, integrity, SGE_STAGE_PACK_CHAR, len,
+			sge_pack_span(frame, frame + len, payload) - payload);
+	}
+	memcpy(out, frame, len);
+	return len;
+}
+
+// like snprintf, a result larger than capacity is the frame size and nothing was written
+int
+sge_decompress(const char* in, size_t len, char* out, size_t capacity) {
+	int integrity, ret;
+	long frame_len;
+	size_t trailer;
+	const char* payload;
+	char* end;
+
+	if (NULL == in || len < 6 || len > INT32_MAX || (NULL == out && capacity > 0)) {
+		return INVALID_PARAM;
+	}
+	if (in[3] != SGE_STAGE_PACK_CHAR && in[3] != SGE_STAGE_LZ_CHAR) {
+		if (len <= capacity) {
+			memcpy(out, in, len);
+		}
+		return len;
+	}
+
+	integrity = in[2] - '0';
+	trailer = (integrity == SGE_INTEGRITY_CRC32C) ? 4 : 0;
+	if (integrity < SGE_INTEGRITY_CRC16 || integrity > SGE_INTEGRITY_CRC32C ||
+		len < SGE_STAGE_HEADER_SIZE + trailer) {
+		SET_ERROR("bytes wrong format.");
+		return SGE_ERR;
+	}
+	sge_decode_number((const uint8_t*)in + 4, &frame_len, 4);
+	frame_len = (uint32_t)frame_len;
+	// no payload byte spreads to more than 8 bytes unpacked or 255 in an LZ length run
+	if ((size_t)frame_len > (len - SGE_STAGE_HEADER_SIZE - trailer) * ((in[3] == SGE_STAGE_LZ_CHAR) ? 255 : 8) ||
+		frame_len > INT32_MAX) {
+		SET_ERROR("bytes wrong format.");
+		return SGE_ERR;
+	}
+	if ((size_t)frame_len > capacity) {
+		return frame_len;
+	}
+	if (SGE_OK != verify_checksum((const uint8_t*)in, len - 2 - trailer, integrity)) {
+		SET_ERROR("invalid protocol");
+		return SGE_ERR;
+	}
+
+	payload = in + SGE_STAGE_HEADER_SIZE;
+	len -= SGE_STAGE_HEADER_SIZE + trailer;
+	if (in[3] == SGE_STAGE_LZ_CHAR) {
+		ret = sge_lz_decompress(payload, len, out, frame_len);
+	} else {
+		// unpacking leaves off the zeros at the end of the frame
+		end = sge_unpack_span(payload, payload + len, out, out + frame_len);
+		ret = (NULL == end) ? SGE_ERR : frame_len;
+		if (NULL != end) {
+			memset(end, 0, out + frame_len - end);
+		}
+	}
+	if (ret != frame_len) {
+		SET_ERROR("bytes wrong format.");
+		return SGE_ERR;
+	}
+	return frame_len;
+}
+
+sge_block_handle
+sge_ctx_frame_block(const sge_context* ctx, const char* buffer) {
+	int integrity;
+	sge_decode_state st;
+
+	if (NULL == ctx || NULL == buffer || ctx->init == 0) {
+		return NULL;
+	}
+	return frame_block(ctx, (const uint8_t*)buffer, &integrity, &st);
+}
+
+sge_block_handle
+sge_frame_block(const char* buffer) {
+	return sge_ctx_frame_block(&protocol, buffer);
+}
+
+int
+sge_ctx_decode_batch(const sge_context* ctx, const char* buffer, size_t len, sge_batch_iter* it) {
+	int integrity, version, presence;
+	long count, entries;
+	const uint8_t *p = (const uint8_t*)buffer;
+
+	if (NULL == ctx || NULL == buffer || NULL == it) {
+		return INVALID_PARAM;
+	}
+
+	if (ctx->init == 0) {
+		return NOT_SCHEME;
+	}
+
+	if (len < SGE_BATCH_HEADER_SIZE || p[3] != SGE_BATCH_CHAR) {
+		SET_ERROR("bytes wrong format.");
+		return SGE_ERR;
+	}
+	integrity = p[2] - '0';
+	version = header_version(p[4], &presence);
+	if (integrity < SGE_INTEGRITY_CRC16 || integrity > SGE_INTEGRITY_CRC32C ||
+		version < SGE_VERSION_1 || version > SGE_VERSION_3) {
+		SET_ERROR("bytes wrong format.");
+		return SGE_ERR;
+	}
+
+	sge_decode_number(p + 5, &count, 4);
+	sge_decode_number(p + 9, &entries, 4);
+	count = (uint32_t)count;
+	entries = (uint32_t)entries;
+	if (len - SGE_BATCH_HEADER_SIZE < (size_t)entries + ((integrity == SGE_INTEGRITY_CRC32C) ? 4 : 0)) {
+		SET_ERROR("bytes wrong format.");
+		return SGE_ERR;
+	}
+	if (SGE_OK != verify_checksum(p, SGE_BATCH_HEADER_SIZE - 2 + entries, integrity)) {
+		SET_ERROR("invalid protocol");
+		return SGE_ERR;
+	}
+
+	it->ctx = ctx;
+	it->cur = buffer + SGE_BATCH_HEADER_SIZE;
+	it->end = it->cur + entries;
+	it->version = version;
+	it->presence = presence;
+	it->left = count;
+	return count;
+}
+
+int
+sge_decode_batch(const char* buffer, size_t len, sge_batch_iter* it) {
+	return sge_ctx_decode_batch(&protocol, buffer, len, it);
+}
+
+// an entry is skipped within its length before it is decoded, so no callback gets bytes from outside of it
+int
+sge_batch_next(sge_batch_iter* it, void* ud, field_set cb, uint32_t* proto_idx) {
+	long value, len;
+	uint32_t idx;
+	size_t byte_len;
+	sge_block *block;
+	sge_decode_state st;
+	const uint8_t *p, *end;
+
+	if (NULL == it || NULL == ud || NULL == cb) {
+		return INVALID_PARAM;
+	}
+	if (it->left == 0) {
+		return 0;
+	}
+
+	p = (const uint8_t*)it->cur;
+	if (it->end - it->cur < 6) {
+		SET_ERROR("bytes wrong format.");
+		return SGE_ERR;
+	}
+	sge_decode_number(p, &value, 2);
+	idx = (uint16_t)value;
+	sge_decode_number(p + 2, &len, 4);
+	len = (uint32_t)len;
+	if (it->end - it->cur - 6 < len) {
+		SET_ERROR("bytes wrong format.");
+		return SGE_ERR;
+	}
+
+	block = sge_index_idx(&it->ctx->index, idx);
+	if (NULL == block) {
+		SET_ERROR("can't found protocol: %d", idx);
+		return SGE_ERR;
+	}
+
+	st.cb = cb;
+	st.version = it->version;
+	st.presence = it->presence;
+	st.defaults = it->ctx->defaults;
+	end = p + 6 + len;
+	if (view_skip_block(block, &st, p + 6, end, 0) != end) {
+		SET_ERROR("bytes wrong format.");
+		return SGE_ERR;
+	}
+	byte_len = sge_decode_block(block, ud, p + 6, &st);
+	if (byte_len != (size_t)len) {
+		SET_ERROR("bytes wrong format.");
+		return SGE_ERR;
+	}
+
+	it->cur += 6 + len;
+	it->left--;
+	if (proto_idx) {
+		*proto_idx = idx;
+	}
+	return 1;
+}
+
+#define DECODER_HEADER	0
+#define DECODER_BODY	1
+#define DECODER_TRAILER	2
+#define DECODER_DONE	3
+
+#define DECODER_FRAMES	8
+
+// a block being decoded (end set) or a list (end NULL, code is the list field). behind presence bitmaps a block's
+// bitmap is at dec->bits + idx, len of its bytes still to be read
+typedef struct {
+	const sge_field_code* code;
+	const sge_field_code* end;
+	void* ud;
+	size_t idx;
+	size_t len;
+} sge_decoder_frame;
+
+struct sge_decoder {
+	const sge_context* ctx;
+	sge_decode_state st;
+	void* ud;
+	int phase;
+	int integrity;
+	int in_string;			// the length of the current string is read, its bytes are not
+	uint32_t proto_idx;
+	uint32_t crc;
+	uint32_t expect;
+	size_t len;
+	size_t more;			// most bytes the input can bring after the current feed, SGE_UNBOUNDED when not known
+	uint8_t tmp[MAX_VARINT_SIZE];
+	size_t tmp_len;
+	char* str;
+	size_t str_len;
+	size_t str_cap;
+	sge_decoder_frame* stack;
+	size_t depth;
+	size_t stack_cap;
+	uint8_t* bits;			// the bitmaps of the blocks on the stack, one after the other
+	size_t bits_len;
+	size_t bits_cap;
+	sge_decoder_frame frames[DECODER_FRAMES];	// the stack until it is deeper
+};
+
+// a fixed size token, straight from the input when it is all there, else collected in dec->tmp
+static const uint8_t*
+take_bytes(sge_decoder* dec, const uint8_t** p, const uint8_t* end, size_t size) {
+	const uint8_t* token = *p;
+	size_t n;
+
+	if (dec->tmp_len == 0 && (size_t)(end - *p) >= size) {
+		*p += size;
+		return token;
+	}
+
+	n = size - dec->tmp_len;
+	n = n < (size_t)(end - *p) ? n : (size_t)(end - *p);
+	memcpy(dec->tmp + dec->tmp_len, *p, n);
+	dec->tmp_len += n;
+	*p += n;
+	if (dec->tmp_len < size) {
+		return NULL;
+	}
+	dec->tmp_len = 0;
+	return dec->tmp;
+}
+
+static const uint8_t*
+take_varint(sge_decoder* dec, const uint8_t** p, const uint8_t* end) {
+	const uint8_t* q = *p;
+	const uint8_t* token = *p;
+
+	if (dec->tmp_len == 0) {
+		while (q < end && q - token < MAX_VARINT_SIZE - 1 && (*q & 0x80)) {
+			++q;
+		}
+		if (q < end) {
+			*p = q + 1;
+			return token;
+		}
+	}
+
+	while (*p < end) {
+		dec->tmp[dec->tmp_len] = *(*p)++;
+		if (!(dec->tmp[dec->tmp_len++] & 0x80) || dec->tmp_len == MAX_VARINT_SIZE) {
+			dec->tmp_len = 0;
+			return dec->tmp;
+		}
+	}
+	return NULL;
+}
+
+static int
+read_integer(sge_decoder* dec, const uint8_t** p, const uint8_t* end, int size, long* value) {
+	const uint8_t* token;
+
+	if (dec->st.version == SGE_VERSION_2) {
+		token = take_varint(dec, p, end);
+	} else {
+		token = take_bytes(dec, p, end, size);
+	}
+	if (NULL == token) {
+		return 0;
+	}
+	decode_integer(&dec->st, token, value, size);
+	return 1;
+}
+
+static int
+read_length(sge_decoder* dec, const uint8_t** p, const uint8_t* end, size_t* len) {
+	const uint8_t* token;
+
+	switch (dec->st.version) {
+		case SGE_VERSION_2:
+			token = take_varint(dec, p, end);
+			break;
+		case SGE_VERSION_3:
+			token = take_bytes(dec, p, end, 4);
+			break;
+		default:
+			token = take_bytes(dec, p, end, 2);
+			break;
+	}
+	if (NULL == token) {
+		return 0;
+	}
+	decode_length(&dec->st, token, len);
+	// every byte of a string and every list item takes at least a byte
+	if (dec->more != SGE_UNBOUNDED && *len > dec->more + (size_t)(end - *p)) {
+		SET_ERROR("bytes wrong format.");
+		return SGE_ERR;
+	}
+	return 1;
+}
+
+static int
+push_frame(sge_decoder* dec, const sge_field_code* code, const sge_field_code* end, void* ud, size_t len) {
+	sge_decoder_frame* frame;
+	size_t cap;
+
+	if (dec->depth == dec->stack_cap) {
+		cap = dec->stack_cap * 2;
+		frame = sge_realloc(dec->stack == dec->frames ? NULL : dec->stack, sizeof(sge_decoder_frame) * cap);
+		if (NULL == frame) {
+			return SGE_ERR;
+		}
+		if (dec->stack == dec->frames) {
+			memcpy(frame, dec->frames, sizeof(dec->frames));
+		}
+		dec->stack = frame;
+		dec->stack_cap = cap;
+	}
+
+	frame = &dec->stack[dec->depth++];
+	frame->code = code;
+	frame->end = end;
+	frame->ud = ud;
+	frame->idx = 0;
+	frame->len = len;
+	return SGE_OK;
+}
+
+static int
+push_block(sge_decoder* dec, const sge_block* block, void* ud) {
+	size_t size = dec->st.presence ? BITMAP_SIZE(block) : 0;
+	size_t cap;
+	uint8_t* bits;
+
+	if (dec->bits_cap - dec->bits_len < size) {
+		cap = dec->bits_cap * 2 > dec->bits_len + size ? dec->bits_cap * 2 : dec->bits_len + size;
+		bits = sge_realloc(dec->bits, cap);
+		if (NULL == bits) {
+			return SGE_ERR;
+		}
+		dec->bits = bits;
+		dec->bits_cap = cap;
+	}
+	if (SGE_OK != push_frame(dec, block->codes, block->codes + block->size, ud, size)) {
+		return SGE_ERR;
+	}
+	dec->stack[dec->depth - 1].idx = dec->bits_len;
+	dec->bits_len += size;
+	return SGE_OK;
+}
+
+// the bytes of a string, copied aside only when they arrive in more than one feed. the copy grows with the bytes that
+// came, not with the length the frame claims; 1 with *str set once it's whole, 0 for more input, SGE_ERR without memory
+static int
+read_string(sge_decoder* dec, const uint8_t** p, const uint8_t* end, const char** str) {
+	size_t n, cap;
+	char* copy;
+
+	if (dec->str_len == 0 && (size_t)(end - *p) >= dec->len) {
+		*str = (const char*)*p;
+		*p += dec->len;
+		return 1;
+	}
+
+	n = dec->len - dec->str_len;
+	n = n < (size_t)(end - *p) ? n : (size_t)(end - *p);
+	if (dec->str_cap - dec->str_len < n) {
+		cap = dec->str_cap * 2 > dec->str_len + n ? dec->str_cap * 2 : dec->str_len + n;
+		cap = cap < dec->len ? cap : dec->len;
+		copy = sge_realloc(dec->str, cap);
+		if (NULL == copy) {
+			return SGE_ERR;
+		}
+		dec->str = copy;
+		dec->str_cap = cap;
+	}
+	memcpy(dec->str + dec->str_len, *p, n);
+	dec->str_len += n;
+	*p += n;
+	if (dec->str_len < dec->len) {
+		return 0;
+	}
+	dec->str_len = 0;
+	*str = dec->str;
+	return 1;
+}
+
+// the items after the current one of a number list, for as long as each is whole in the input
+static void
+decoder_numbers(sge_decoder* dec, sge_decoder_frame* frame, const uint8_t** p, const uint8_t* end) {
+	const sge_field_code* code = frame->code;
+	size_t need = dec->st.version == SGE_VERSION_2 ? MAX_VARINT_SIZE : (size_t)code->width;
+	long value;
+
+	while (frame->idx + 1 < frame->len && (size_t)(end - *p) >= need) {
+		*p += decode_integer(&dec->st, *p, &value, code->width);
+		sge_set_number(frame->ud, dec->st.cb, code, value, ++frame->idx);
+	}
+}
+
+// run the field programs on the stack until it is empty (1), the input runs out (0) or an error
+static int
+decoder_run(sge_decoder* dec, const uint8_t** p, const uint8_t* end) {
+	sge_decoder_frame* frame;
+	const sge_field_code* code;
+	const char* str;
+	void* ud;
+	int32_t idx;
+	uint8_t opcode;
+	long value;
+	size_t len;
+	int ret;
+	sge_value sv;
+
+	while (dec->depth) {
+		frame = &dec->stack[dec->depth - 1];
+		code = frame->code;
+		ud = frame->ud;
+		if (frame->end) {
+			if (code == frame->end) {
+				dec->bits_len = frame->idx;
+				dec->depth--;
+				continue;
+			}
+			if (frame->len) {
+				len = (size_t)(end - *p) < frame->len ? (size_t)(end - *p) : frame->len;
+				memcpy(dec->bits + dec->bits_len - frame->len, *p, len);
+				*p += len;
+				frame->len -= len;
+				if (frame->len) {
+					return 0;
+				}
+			}
+			if (dec->st.presence && !FIELD_PRESENT(dec->bits + frame->idx, code->ordinal)) {
+				if (dec->st.defaults == SGE_DEFAULTS_FILL) {
+					decode_default(code, ud, &dec->st);
+				}
+				frame->code++;
+				continue;
+			}
+			idx = -1;
+			opcode = code->opcode;
+		} else {
+			if (frame->idx == frame->len) {
+				dec->depth--;
+				continue;
+			}
+			idx = frame->idx;
+			switch (code->opcode) {
+				case SGE_OP_NUMBER_LIST:
+					opcode = SGE_OP_NUMBER;
+					break;
+				case SGE_OP_STRING_LIST:
+					opcode = SGE_OP_STRING;
+					break;
+				default:
+					opcode = SGE_OP_CUSTOM;
+					break;
+			}
+		}
+
+		if (*p == end) {
+			return 0;
+		}
+
+		sv = (sge_value)NEW_SGE_VALUE;
+		set_field(&sv, code);
+		switch (opcode) {
+			case SGE_OP_NUMBER:
+				if (!read_integer(dec, p, end, code->width, &value)) {
+					return 0;
+				}
+				sge_set_number(ud, dec->st.cb, code, value, idx);
+				if (idx >= 0) {
+					decoder_numbers(dec, frame, p, end);
+				}
+				break;
+			case SGE_OP_STRING:
+				if (!dec->in_string) {
+					ret = read_length(dec, p, end, &dec->len);
+					if (ret <= 0) {
+						return ret;
+					}
+					dec->in_string = 1;
+				}
+				if (dec->len) {
+					ret = read_string(dec, p, end, &str);
+					if (ret <= 0) {
+						return ret;
+					}
+					sv.idx = idx;
+					sv.ptr = str;
+					sv.len = dec->len;
+					sv.vt = SGE_STRING;
+					dec->st.cb(ud, &sv);
+				}
+				dec->in_string = 0;
+				break;
+			case SGE_OP_CUSTOM:
+				str = NULL;
+				if (!frame->end || !dec->st.presence) {
+					str = (const char*)take_bytes(dec, p, end, 1);
+					if (NULL == str) {
+						return 0;
+					}
+				}
+				if (frame->end) {
+					frame->code++;
+				} else {
+					frame->idx++;
+				}
+				if (str && *str == 0) {
+					continue;
+				}
+				sv.idx = idx;
+				sv.vt = SGE_DICT;
+				ud = dec->st.cb(ud, &sv);
+				if (SGE_OK != push_block(dec, code->block, ud)) {
+					return SGE_ERR;
+				}
+				continue;
+			default:
+				ret = read_length(dec, p, end, &len);
+				if (ret <= 0) {
+					return ret;
+				}
+				frame->code++;
+				sv.len = len;
+				sv.vt = SGE_LIST;
+				ud = dec->st.cb(ud, &sv);
+				if (SGE_OK != push_frame(dec, code, NULL, ud, len)) {
+					return SGE_ERR;
+				}
+				continue;
+		}
+
+		if (frame->end) {
+			frame->code++;
+		} else {
+			frame->idx++;
+		}
+	}
+
+	return 1;
+}
+
+static void
+update_crc(sge_decoder* dec, const uint8_t* data, size_t len) {
+	switch (dec->integrity) {
+		case SGE_INTEGRITY_CRC32C:
+			dec->crc = sge_crc32c_update(dec->crc, (const char*)data, len);
+			break;
+		case SGE_INTEGRITY_CRC16:
+			dec->crc = sge_crc16_update(dec->crc, (const char*)data, len);
+			break;
+	}
+}
+
+static int
+decoder_header(sge_decoder* dec, const uint8_t* header) {
+	sge_block* block;
+	long value;
+
+	dec->integrity = header[2] - '0';
+	dec->st.version = header_version(header[3], &dec->st.presence);
+	dec->st.defaults = dec->ctx->defaults;
+	if (dec->integrity < SGE_INTEGRITY_CRC16 || dec->integrity > SGE_INTEGRITY_CRC32C ||
+		dec->st.version < SGE_VERSION_1 || dec->st.version > SGE_VERSION_3) {
+		SET_ERROR("bytes wrong format.");
+		return SGE_ERR;
+	}
+
+	sge_decode_number(header, &value, 2);
+	dec->expect = (uint16_t)value;
+	sge_decode_number(header + 4, &value, 2);
+	dec->proto_idx = (uint16_t)value;
+
+	block = sge_index_idx(&dec->ctx->index, dec->proto_idx);
+	if (NULL == block) {
+		SET_ERROR("can't found protocol: %d", dec->proto_idx);
+		return SGE_ERR;
+	}
+
+	dec->crc = 0;
+	update_crc(dec, header + 2, 4);
+	return push_block(dec, block, dec->ud);
+}
+
+static void
+init_decoder(sge_decoder* dec, const sge_context* ctx, void* ud, field_set cb) {
+	memset(dec, 0, offsetof(sge_decoder, frames));
+	dec->ctx = ctx;
+	dec->st.cb = cb;
+	dec->ud = ud;
+	dec->stack = dec->frames;
+	dec->stack_cap = DECODER_FRAMES;
+	dec->more = SGE_UNBOUNDED;
+}
+
+static void
+clear_decoder(sge_decoder* dec) {
+	sge_free(dec->str);
+	sge_free(dec->bits);
+	if (dec->stack != dec->frames) {
+		sge_free(dec->stack);
+	}
+}
 
-	if (NULL == name || NULL == ud || NULL == buffer || NULL == cb) {
-		return INVALID_PARAM;
+sge_decoder*
+sge_ctx_decoder_new(const sge_context* ctx, void* ud, field_set cb) {
+	sge_decoder* dec;
+
+	if (NULL == ctx || NULL == cb) {
+		return NULL;
 	}
 
-	if (protocol.init == 0) {
-		return NOT_SCHEME;
+	dec = sge_malloc(sizeof(sge_decoder));
+	if (NULL == dec) {
+		return NULL;
 	}
+	init_decoder(dec, ctx, ud, cb);
+	return dec;
+}
 
-	keylen = strlen(name);
-	block = (sge_block*)sge_table_get(protocol.ht_name, name, keylen);
-	if (NULL == block) {
-		SET_ERROR(&protocol, "can't found protocol: %s", name);
-		return SGE_ERR;
+sge_decoder*
+sge_decoder_new(void* ud, field_set cb) {
+	return sge_ctx_decoder_new(&protocol, ud, cb);
+}
+
+void
+sge_decoder_reset(sge_decoder* dec, void* ud) {
+	dec->ud = ud;
+	dec->phase = DECODER_HEADER;
+	dec->in_string = 0;
+	dec->tmp_len = 0;
+	dec->str_len = 0;
+	dec->depth = 0;
+	dec->bits_len = 0;
+}
+
+void
+sge_decoder_free(sge_decoder* dec) {
+	if (NULL == dec) {
+		return;
 	}
+	clear_decoder(dec);
+	sge_free(dec);
+}
 
-	p_buffer += 2;
-	memcpy(p_buffer, SGE_PROTOCOL_HEADER, SGE_PROTOCOL_HEADER_SIZE);
-	p_buffer += 2;
-	p_buffer += sge_encode_number(p_buffer, block->idx, 2);
-	offset = sge_encode_block(block, ud, p_buffer, cb);
-	crc = sge_crc16(buffer + 2, offset + 4);
-	sge_encode_number((uint8_t*)buffer, crc, 2);
-	return offset + 6;
+uint32_t
+sge_decoder_proto(const sge_decoder* dec) {
+	return dec->proto_idx;
 }
 
 int
-sge_decode(const char* buffer, void* ud, field_set cb) {
-	uint32_t proto_idx;
-	uint16_t s_crc, d_crc;
-	size_t byte_len;
-	sge_block *block = NULL;
-	long l_proto_idx, l_s_crc;
-	const uint8_t *p = (uint8_t *)buffer;
+sge_decoder_feed(sge_decoder* dec, const char* bytes, size_t len, size_t* used) {
+	const uint8_t *p = (const uint8_t*)bytes;
+	const uint8_t *end = p + len;
+	const uint8_t *body, *token;
+	int ret = SGE_DECODER_MORE;
 
-	if (NULL == buffer || NULL == ud || NULL == cb) {
+	if (NULL == dec || (NULL == bytes && len) || NULL == dec->ud || dec->phase == DECODER_DONE) {
 		return INVALID_PARAM;
 	}
 
-	if (protocol.init == 0) {
+	if (dec->ctx->init == 0) {
 		return NOT_SCHEME;
 	}
 
-	p += sge_decode_number(p, &l_s_crc, 2);
-	s_crc = (uint16_t)l_s_crc;
+	if (dec->phase == DECODER_HEADER) {
+		token = take_bytes(dec, &p, end, 6);
+		if (token) {
+			ret = decoder_header(dec, token);
+			dec->phase = DECODER_BODY;
+		}
+	}
 
-	if (memcmp(p, SGE_PROTOCOL_HEADER, SGE_PROTOCOL_HEADER_SIZE) != 0) {
-		SET_ERROR(&protocol, "bytes wrong format.");
-		return SGE_ERR;
+	if (ret == SGE_OK && dec->phase == DECODER_BODY) {
+		body = p;
+		ret = decoder_run(dec, &p, end);
+		update_crc(dec, body, p - body);
+		if (ret == 1) {
+			dec->phase = DECODER_TRAILER;
+			ret = SGE_DECODER_MORE;
+		}
 	}
-	
-	p += SGE_PROTOCOL_HEADER_SIZE;
-	sge_decode_number(p, &l_proto_idx, 2);
-	proto_idx = (uint32_t)l_proto_idx;
-	p += 2;
 
-	block = (sge_block*)sge_table_get(protocol.ht_idx, (void*)&proto_idx, -1);
-	if (NULL == block) {
-		SET_ERROR(&protocol, "can't found protocol: %d", proto_idx);
-		return SGE_ERR;
+	if (ret == SGE_OK && dec->phase == DECODER_TRAILER) {
+		token = dec->tmp;
+		if (dec->integrity == SGE_INTEGRITY_CRC32C) {
+			token = take_bytes(dec, &p, end, 4);
+			if (token) {
+				dec->expect = ((uint32_t)token[0] << 24) | (token[1] << 16) | (token[2] << 8) | token[3];
+			}
+		}
+		if (token) {
+			dec->phase = DECODER_DONE;
+			ret = SGE_DECODER_DONE;
+			if (dec->integrity != SGE_INTEGRITY_NONE && dec->crc != dec->expect) {
+				SET_ERROR("invalid protocol");
+				ret = SGE_ERR;
+			}
+		}
 	}
-	byte_len = sge_decode_block(block, ud, p, cb);
-	d_crc = sge_crc16(buffer + 2, byte_len + 4);
-	if (s_crc != d_crc) {
-		SET_ERROR(&protocol, "invalid protocol");
-		return SGE_ERR;
+
+	if (used) {
+		*used = p - (const uint8_t*)bytes;
+	}
+	if (ret < 0) {
+		dec->phase = DECODER_DONE;
+	}
+	return ret;
+}
+
+
+// the decoder is fed SGE_PACK_CHUNK_SIZE bytes at a time, unpacked from whole groups of the input. the last group comes
+// with its trailing zeros, which sge_unpack leaves off, so the frame's last fields and check read as written
+int
+sge_ctx_decode_packed(const sge_context* ctx, const char* buffer, size_t len, void* ud, field_set cb) {
+	char chunk[SGE_PACK_CHUNK_SIZE];
+	const char* p = buffer;
+	const char* end = buffer + len;
+	size_t groups;
+	sge_decoder dec;
+	int ret = SGE_DECODER_MORE;
+
+	if (NULL == ctx || NULL == buffer || 0 == len || NULL == ud || NULL == cb) {
+		return INVALID_PARAM;
+	}
+
+	if (ctx->init == 0) {
+		return NOT_SCHEME;
 	}
 
-	return proto_idx;
+	init_decoder(&dec, ctx, ud, cb);
+	while (ret == SGE_DECODER_MORE && p < end) {
+		groups = SGE_PACK_CHUNK_SIZE / 8;
+		p = sge_unpack_groups(p, end, chunk, &groups);
+		if (NULL == p) {
+			SET_ERROR("bytes wrong format.");
+			ret = SGE_ERR;
+			break;
+		}
+		// a packed byte unpacks to 8 at most, longer lengths are rejected before anything is sized by them
+		dec.more = (size_t)(end - p) * 8;
+		ret = sge_decoder_feed(&dec, chunk, groups * 8, NULL);
+	}
+	if (ret == SGE_DECODER_MORE) {
+		SET_ERROR("bytes wrong format.");
+		ret = SGE_ERR;
+	}
+
+	clear_decoder(&dec);
+	return ret == SGE_DECODER_DONE ? (int)dec.proto_idx : ret;
 }
 
 int
-sge_pack(const char* in_str, int len, char* out_str) {
-	int move_step = 0;
-	char* mask = out_str;
-	char* p_out = out_str + 1;
-	const char* p_in = in_str;
+sge_decode_packed(const char* buffer, size_t len, void* ud, field_set cb) {
+	return sge_ctx_decode_packed(&protocol, buffer, len, ud, cb);
+}
 
-	if (in_str == NULL || out_str == NULL || len <= 0) {
-		return INVALID_PARAM;
+#define VIEW_FIELDS		16
+#define VIEW_MAX_DEPTH	1024	// custom fields nested deeper than this are taken for a malformed frame
+
+// a field that has bytes in the view's block, all of them without a bitmap
+#define VIEW_PRESENT(view, code)	(NULL == (view)->bitmap || FIELD_PRESENT((view)->bitmap, (code)->ordinal))
+
+struct sge_view {
+	const sge_block* block;
+	const uint8_t* end;
+	sge_decode_state st;
+	const uint8_t* bitmap;		// NULL without presence bitmaps
+	uint32_t known;				// fields whose start is in fields
+	const uint8_t** fields;
+	uint32_t item_ordinal;		// the list item last looked up, the next ones are found from there
+	size_t item_idx;
+	const uint8_t* item;
+	long number;
+	const uint8_t* inline_fields[VIEW_FIELDS];
+};
+
+// the size of the integer or length of width bytes at p, 0 when it runs past end
+static size_t
+view_token(int version, const uint8_t* p, const uint8_t* end, size_t width) {
+	const uint8_t* q = p;
+
+	if (version != SGE_VERSION_2) {
+		return (size_t)(end - p) >= width ? width : 0;
+	}
+	while (q < end && q - p < MAX_VARINT_SIZE - 1 && (*q & 0x80)) {
+		++q;
+	}
+	return q < end ? (size_t)(q - p) + 1 : 0;
+}
+
+static const uint8_t*
+view_length(int version, const uint8_t* p, const uint8_t* end, size_t* len) {
+	sge_decode_state st;
+	size_t n = view_token(version, p, end, version == SGE_VERSION_3 ? 4 : 2);
+
+	if (n == 0) {
+		return NULL;
+	}
+	st.version = version;
+	decode_length(&st, p, len);
+	return p + n;
+}
+
+static const uint8_t* view_skip(const sge_field_code* code, int opcode, const sge_decode_state* st, const uint8_t* p,
+	const uint8_t* end, int depth);
+
+// the end of the fields of block at p, with its bitmap in front of them when the frame has bitmaps
+static const uint8_t*
+view_skip_block(const sge_block* block, const sge_decode_state* st, const uint8_t* p, const uint8_t* end, int depth) {
+	const sge_field_code *c, *last = block->codes + block->size;
+	const uint8_t* bitmap = p;
+
+	if (st->presence) {
+		if ((size_t)(end - p) < BITMAP_SIZE(block)) {
+			return NULL;
+		}
+		p += BITMAP_SIZE(block);
+	}
+	for (c = block->codes; p && c < last; ++c) {
+		if (!st->presence || FIELD_PRESENT(bitmap, c->ordinal)) {
+			p = view_skip(c, c->opcode, st, p, end, depth);
+		}
 	}
+	return p;
+}
+
+// the end of a value of code at p, opcode is the code's own or that of its list items; NULL when it runs past end
+static const uint8_t*
+view_skip(const sge_field_code* code, int opcode, const sge_decode_state* st, const uint8_t* p, const uint8_t* end,
+	int depth) {
+	size_t len, i, n;
+
+	switch (opcode) {
+		case SGE_OP_NUMBER:
+			n = view_token(st->version, p, end, code->width);
+			return n ? p + n : NULL;
+		case SGE_OP_STRING:
+			p = view_length(st->version, p, end, &len);
+			return p && (size_t)(end - p) >= len ? p + len : NULL;
+		case SGE_OP_CUSTOM:
+			if (depth >= VIEW_MAX_DEPTH) {
+				return NULL;
+			}
+			// behind bitmaps only the items of a custom list have a flag byte
+			if (!st->presence || code->opcode == SGE_OP_CUSTOM_LIST) {
+				if (p >= end) {
+					return NULL;
+				}
+				if (*p++ == 0) {
+					return p;
+				}
+			}
+			return view_skip_block(code->block, st, p, end, depth + 1);
+	}
+
+	p = view_length(st->version, p, end, &len);
+	if (NULL == p) {
+		return NULL;
+	}
+	if (opcode == SGE_OP_NUMBER_LIST && st->version != SGE_VERSION_2) {
+		return len <= (size_t)(end - p) / code->width ? p + len * code->width : NULL;
+	}
+	// every item takes at least a byte, a bad count stops at end
+	opcode = opcode == SGE_OP_NUMBER_LIST ? SGE_OP_NUMBER : opcode == SGE_OP_STRING_LIST ? SGE_OP_STRING : SGE_OP_CUSTOM;
+	for (i = 0; p && i < len; ++i) {
+		p = view_skip(code, opcode, st, p, end, depth);
+	}
+	return p;
+}
+
+// the start of field ordinal, skipping the fields before it that aren't known yet
+static const uint8_t*
+view_seek(sge_view* view, uint32_t ordinal) {
+	const sge_field_code* code;
+	const uint8_t* p;
+
+	while (view->known <= ordinal) {
+		code = view->block->codes + view->known - 1;
+		p = view->fields[view->known - 1];
+		if (VIEW_PRESENT(view, code)) {
+			p = view_skip(code, code->opcode, &view->st, p, view->end, 0);
+		}
+		if (NULL == p) {
+			SET_ERROR("bytes wrong format.");
+			return NULL;
+		}
+		view->fields[view->known++] = p;
+	}
+	return view->fields[ordinal];
+}
+
+static int
+view_value(sge_view* view, const sge_field_code* code, int opcode, const uint8_t* p, int32_t idx, sge_value* value) {
+	size_t len;
+
+	*value = (sge_value)NEW_SGE_VALUE;
+	set_field(value, code);
+	value->idx = idx;
+	switch (opcode) {
+		case SGE_OP_NUMBER:
+			if (0 == view_token(view->st.version, p, view->end, code->width)) {
+				break;
+			}
+			decode_integer(&view->st, p, &view->number, code->width);
+			value->ptr = &view->number;
+			value->vt = SGE_NUMBER;
+			return SGE_OK;
+		case SGE_OP_STRING:
+			p = view_length(view->st.version, p, view->end, &len);
+			if (NULL == p || (size_t)(view->end - p) < len) {
+				break;
+			}
+			value->ptr = p;
+			value->len = len;
+			value->vt = SGE_STRING;
+			return SGE_OK;
+		case SGE_OP_CUSTOM:
+			// a custom field behind a bitmap is set when it has bytes at all
+			if (view->bitmap && code->opcode == SGE_OP_CUSTOM) {
+				value->ptr = code->block;
+				value->vt = SGE_DICT;
+				return SGE_OK;
+			}
+			if (p >= view->end) {
+				break;
+			}
+			value->ptr = *p ? code->block : NULL;
+			value->vt = SGE_DICT;
+			return SGE_OK;
+		default:
+			p = view_length(view->st.version, p, view->end, &len);
+			if (NULL == p || len > (size_t)(view->end - p)) {
+				break;
+			}
+			value->len = len;
+			value->vt = SGE_LIST;
+			return SGE_OK;
+	}
+	SET_ERROR("bytes wrong format.");
+	return SGE_ERR;
+}
+
+// a field a bitmap left out reads as the value sge_decode gives it: a 0, an empty string or list, an unset custom field
+static int
+view_default(sge_view* view, const sge_field_code* code, sge_value* value) {
+	*value = (sge_value)NEW_SGE_VALUE;
+	set_field(value, code);
+	switch (code->opcode) {
+		case SGE_OP_NUMBER:
+			view->number = 0;
+			value->ptr = &view->number;
+			value->vt = SGE_NUMBER;
+			break;
+		case SGE_OP_STRING:
+			value->vt = SGE_STRING;
+			break;
+		case SGE_OP_CUSTOM:
+			value->vt = SGE_DICT;
+			break;
+		default:
+			value->vt = SGE_LIST;
+			break;
+	}
+	return SGE_OK;
+}
+
+// item idx of list field ordinal, reached from the last item looked up when that was an earlier one of the same list
+static const uint8_t*
+view_item(sge_view* view, uint32_t ordinal, size_t idx, int* opcode) {
+	const sge_field_code* code = view->block->codes + ordinal;
+	const uint8_t* p;
+	size_t len = 0, i = 0;
+
+	switch (code->opcode) {
+		case SGE_OP_NUMBER_LIST:
+			*opcode = SGE_OP_NUMBER;
+			break;
+		case SGE_OP_STRING_LIST:
+			*opcode = SGE_OP_STRING;
+			break;
+		case SGE_OP_CUSTOM_LIST:
+			*opcode = SGE_OP_CUSTOM;
+			break;
+		default:
+			SET_ERROR("field %s isn't a list", code->name);
+			return NULL;
+	}
+
+	p = view_seek(view, ordinal);
+	if (p && VIEW_PRESENT(view, code)) {
+		p = view_length(view->st.version, p, view->end, &len);
+	}
+	if (NULL == p || idx >= len) {
+		SET_ERROR(p ? "item %zu of a %zu item list" : "bytes wrong format.", idx, len);
+		return NULL;
+	}
+	if (*opcode == SGE_OP_NUMBER && view->st.version != SGE_VERSION_2) {
+		if (len > (size_t)(view->end - p) / code->width) {
+			SET_ERROR("bytes wrong format.");
+			return NULL;
+		}
+		return p + idx * code->width;
+	}
+
+	if (view->item && view->item_ordinal == ordinal && view->item_idx <= idx) {
+		p = view->item;
+		i = view->item_idx;
+	}
+	for (; p && i < idx; ++i) {
+		p = view_skip(code, *opcode, &view->st, p, view->end, 0);
+	}
+	if (NULL == p) {
+		SET_ERROR("bytes wrong format.");
+		return NULL;
+	}
+	view->item_ordinal = ordinal;
+	view->item_idx = idx;
+	view->item = p;
+	return p;
+}
+
+static sge_view*
+new_view(const sge_block* block, const uint8_t* body, const uint8_t* end, const sge_decode_state* st) {
+	sge_view* view;
 
-	while(len-- > 0) {
-		if (move_step == PACK_UNIT_SIZE) {
-			move_step = 0;
-			mask = p_out;
-			p_out++;
+	if (st->presence && (size_t)(end - body) < BITMAP_SIZE(block)) {
+		SET_ERROR("bytes wrong format.");
+		return NULL;
+	}
+	view = sge_malloc(sizeof(sge_view));
+	if (NULL == view) {
+		return NULL;
+	}
+	view->fields = view->inline_fields;
+	if (block->size > VIEW_FIELDS) {
+		view->fields = sge_malloc(sizeof(uint8_t*) * block->size);
+		if (NULL == view->fields) {
+			sge_free(view);
+			return NULL;
 		}
-		if (*p_in) {
-			*p_out = *p_in;
-			*mask |= (1 << move_step);
-			p_out++;
+	}
+	view->block = block;
+	view->end = end;
+	view->st = *st;
+	view->bitmap = NULL;
+	if (st->presence) {
+		view->bitmap = body;
+		body += BITMAP_SIZE(block);
+	}
+	view->fields[0] = body;
+	view->known = 1;
+	view->item = NULL;
+	return view;
+}
+
+sge_view*
+sge_ctx_view_open(const sge_context* ctx, const char* buffer, size_t len) {
+	const sge_block* block;
+	int integrity;
+	sge_decode_state st;
+
+	if (NULL == ctx || NULL == buffer || len < 6 || ctx->init == 0) {
+		return NULL;
+	}
+
+	block = frame_block(ctx, (const uint8_t*)buffer, &integrity, &st);
+	if (NULL == block || (integrity == SGE_INTEGRITY_CRC32C && len < 10)) {
+		return NULL;
+	}
+	return new_view(block, (const uint8_t*)buffer + 6,
+		(const uint8_t*)buffer + len - (integrity == SGE_INTEGRITY_CRC32C ? 4 : 0), &st);
+}
+
+sge_view*
+sge_view_open(const char* buffer, size_t len) {
+	return sge_ctx_view_open(&protocol, buffer, len);
+}
+
+sge_view*
+sge_view_child(sge_view* view, uint32_t ordinal, int32_t idx) {
+	const sge_field_code* code;
+	const uint8_t* p;
+	int opcode = SGE_OP_CUSTOM;
+
+	if (NULL == view || ordinal >= view->block->size) {
+		return NULL;
+	}
+
+	code = view->block->codes + ordinal;
+	if (code->opcode != SGE_OP_CUSTOM && code->opcode != SGE_OP_CUSTOM_LIST) {
+		SET_ERROR("field %s isn't a custom type", code->name);
+		return NULL;
+	}
+	if (idx < 0 && code->opcode == SGE_OP_CUSTOM) {
+		p = view_seek(view, ordinal);
+		// behind a bitmap the field is set when its bit is, and has no flag byte
+		if (view->bitmap) {
+			return p && VIEW_PRESENT(view, code) ? new_view(code->block, p, view->end, &view->st) : NULL;
 		}
-		p_in++;
-		move_step++;
+	} else {
+		p = view_item(view, ordinal, idx, &opcode);
+	}
+	if (NULL == p || p >= view->end || *p == 0) {
+		return NULL;
 	}
-	return p_out - out_str;
+	return new_view(code->block, p + 1, view->end, &view->st);
+}
+
+void
+sge_view_free(sge_view* view) {
+	if (NULL == view) {
+		return;
+	}
+	if (view->fields != view->inline_fields) {
+		sge_free(view->fields);
+	}
+	sge_free(view);
+}
+
+sge_block_handle
+sge_view_block(const sge_view* view) {
+	return view ? view->block : NULL;
 }
 
 int
-sge_unpack(const char* in_str, int len, char* out_str) {
-	int move_step = 0;
-	char mask = *in_str;
-	const char* p_in = in_str + 1;
-	char* p_out = out_str;
-	unsigned char c = 0;
+sge_view_field(sge_view* view, uint32_t ordinal, sge_value* value) {
+	const sge_field_code* code;
+	const uint8_t* p;
 
-	if (in_str == NULL || out_str == NULL || len == 0) {
+	if (NULL == view || NULL == value || ordinal >= view->block->size) {
 		return INVALID_PARAM;
 	}
 
-	len--;
-	while(len > 0) {
-		c = mask & (0x01 << move_step);
-		if (c) {
-			*p_out = *p_in;
-			len--;
-			p_in++;
-		} else {
-			*p_out = 0x00;
+	code = view->block->codes + ordinal;
+	p = view_seek(view, ordinal);
+	if (NULL == p) {
+		return SGE_ERR;
+	}
+	if (!VIEW_PRESENT(view, code)) {
+		return view_default(view, code, value);
+	}
+	return view_value(view, code, code->opcode, p, -1, value);
+}
+
+int
+sge_view_get(sge_view* view, const char* name, sge_value* value) {
+	const sge_field_code* code;
+
+	if (NULL == view || NULL == name || NULL == value) {
+		return INVALID_PARAM;
+	}
+
+	code = sge_block_code(view->block, name, strlen(name));
+	if (NULL == code) {
+		SET_ERROR("%s has no field %s", view->block->name, name);
+		return SGE_ERR;
+	}
+	return sge_view_field(view, code->ordinal, value);
+}
+
+int
+sge_view_item(sge_view* view, uint32_t ordinal, size_t idx, sge_value* value) {
+	const uint8_t* p;
+	int opcode;
+
+	if (NULL == view || NULL == value || ordinal >= view->block->size || idx > INT32_MAX) {
+		return INVALID_PARAM;
+	}
+
+	p = view_item(view, ordinal, idx, &opcode);
+	if (NULL == p) {
+		return SGE_ERR;
+	}
+	return view_value(view, view->block->codes + ordinal, opcode, p, (int32_t)idx, value);
+}
+
+// the fields of a block a projection keeps, per field: NULL skipped, &project_all decoded whole, else the fields kept
+// of a custom field or of every item of a custom list
+typedef struct sge_projection_node {
+	const sge_block* block;
+	struct sge_projection_node* fields[0];
+} sge_projection_node;
+
+struct sge_projection {
+	const sge_context* ctx;
+	size_t count;
+	sge_projection_node** roots;	// one per block a path starts with
+};
+
+static sge_projection_node project_all;
+
+static sge_projection_node*
+new_projection_node(const sge_block* block) {
+	size_t size = sizeof(sge_projection_node) + sizeof(sge_projection_node*) * block->size;
+	sge_projection_node* node = sge_malloc(size);
+
+	if (node) {
+		memset(node, 0, size);
+		node->block = block;
+	}
+	return node;
+}
+
+static void
+free_projection_node(sge_projection_node* node) {
+	uint32_t i;
+
+	if (NULL == node || node == &project_all) {
+		return;
+	}
+	for (i = 0; i < node->block->size; ++i) {
+		free_projection_node(node->fields[i]);
+	}
+	sge_free(node);
+}
+
+// path is Block.field.field..., a custom list may be written field[]; a path of a block alone keeps all of it
+static int
+add_projection_path(sge_projection* proj, const char* path) {
+	const sge_field_code* code;
+	const sge_block* block;
+	sge_projection_node* node = NULL;
+	const char* seg = path;
+	size_t len, i;
+	int list;
+
+	len = strcspn(seg, ".");
+	block = len ? sge_table_get(proj->ctx->ht_name, seg, len) : NULL;
+	if (NULL == block) {
+		SET_ERROR("can't found protocol: %.*s", (int)len, seg);
+		return SGE_ERR;
+	}
+	for (i = 0; i < proj->count; ++i) {
+		if (proj->roots[i]->block == block) {
+			node = proj->roots[i];
+			break;
+		}
+	}
+	if (NULL == node) {
+		node = new_projection_node(block);
+		if (NULL == node) {
+			return SGE_ERR;
+		}
+		proj->roots[proj->count++] = node;
+	}
+	if (seg[len] == 0) {
+		for (i = 0; i < block->size; ++i) {
+			free_projection_node(node->fields[i]);
+			node->fields[i] = &project_all;
+		}
+		return SGE_OK;
+	}
+
+	for (;;) {
+		seg += len + 1;
+		len = strcspn(seg, ".");
+		list = len > 2 && 0 == memcmp(seg + len - 2, "[]", 2);
+		code = sge_block_code(node->block, seg, len - list * 2);
+		if (NULL == code || (list && code->opcode != SGE_OP_NUMBER_LIST && code->opcode != SGE_OP_STRING_LIST &&
+			code->opcode != SGE_OP_CUSTOM_LIST)) {
+			SET_ERROR("%s has no field %.*s", node->block->name, (int)len, seg);
+			return SGE_ERR;
 		}
-		move_step++;
-		p_out++;
-		if (move_step == PACK_UNIT_SIZE) {
-			move_step = 0;
-			mask = *p_in;
-			len--;
-			p_in++;
+		if (node->fields[code->ordinal] == &project_all) {
+			return SGE_OK;
+		}
+		if (seg[len] == 0) {
+			free_projection_node(node->fields[code->ordinal]);
+			node->fields[code->ordinal] = &project_all;
+			return SGE_OK;
+		}
+		if (code->opcode != SGE_OP_CUSTOM && code->opcode != SGE_OP_CUSTOM_LIST) {
+			SET_ERROR("field %s isn't a custom type", code->name);
+			return SGE_ERR;
+		}
+		if (NULL == node->fields[code->ordinal]) {
+			node->fields[code->ordinal] = new_projection_node(code->block);
+			if (NULL == node->fields[code->ordinal]) {
+				return SGE_ERR;
+			}
+		}
+		node = node->fields[code->ordinal];
+	}
+}
+
+sge_projection*
+sge_ctx_projection_new(const sge_context* ctx, const char* const* paths, size_t count) {
+	sge_projection* proj;
+	size_t i;
+
+	if (NULL == ctx || (NULL == paths && count) || ctx->init == 0) {
+		return NULL;
+	}
+
+	proj = sge_malloc(sizeof(sge_projection));
+	if (NULL == proj) {
+		return NULL;
+	}
+	proj->ctx = ctx;
+	proj->count = 0;
+	proj->roots = sge_malloc(sizeof(sge_projection_node*) * (count ? count : 1));
+	if (NULL == proj->roots) {
+		sge_free(proj);
+		return NULL;
+	}
+	for (i = 0; i < count; ++i) {
+		if (NULL == paths[i] || SGE_OK != add_projection_path(proj, paths[i])) {
+			sge_projection_free(proj);
+			return NULL;
 		}
 	}
+	return proj;
+}
 
-	return p_out - out_str;
+sge_projection*
+sge_projection_new(const char* const* paths, size_t count) {
+	return sge_ctx_projection_new(&protocol, paths, count);
 }
 
 void
-sge_destroy(int clean) {
-	sge_block* block;
-	sge_list* pb, *pb_next;
+sge_projection_free(sge_projection* proj) {
+	size_t i;
 
-	for (pb = protocol.block_head.next; !LIST_EMPTY(&protocol.block_head); ) {
-		pb_next = pb->next;
-		block = LIST_DATA(pb, sge_block, head);
-		sge_destroy_block(block);
-		pb = pb_next;
+	if (NULL == proj) {
+		return;
 	}
+	for (i = 0; i < proj->count; ++i) {
+		free_projection_node(proj->roots[i]);
+	}
+	sge_free(proj->roots);
+	sge_free(proj);
+}
 
-	if (clean) {
-		memset(protocol.err, 0, sizeof(protocol.err));
+static const uint8_t* decode_projected_block(const sge_block* block, const sge_projection_node* node, void* ud,
+	const uint8_t* p, const uint8_t* end, const sge_decode_state* st, int depth);
+
+static const uint8_t*
+decode_projected_dict(const sge_field_code* code, const sge_projection_node* node, void* ud, const uint8_t* p,
+	const uint8_t* end, const sge_decode_state* st, int32_t idx, int depth) {
+	sge_value sv = NEW_SGE_VALUE;
+
+	if (depth >= VIEW_MAX_DEPTH) {
+		return NULL;
+	}
+	if (!st->presence || code->opcode == SGE_OP_CUSTOM_LIST) {
+		if (p >= end) {
+			return NULL;
+		}
+		if (*p++ == 0) {
+			return p;
+		}
+	}
+	set_field(&sv, code);
+	sv.vt = SGE_DICT;
+	sv.idx = idx;
+	ud = st->cb(ud, &sv);
+	return decode_projected_block(code->block, node, ud, p, end, st, depth + 1);
+}
+
+// kept fields are checked against end by skipping them before they are decoded, the others are only skipped
+static const uint8_t*
+decode_projected_block(const sge_block* block, const sge_projection_node* node, void* ud,
+	const uint8_t* p, const uint8_t* end, const sge_decode_state* st, int depth) {
+	const sge_field_code *code = block->codes;
+	const sge_field_code *last = code + block->size;
+	const sge_projection_node* keep;
+	const uint8_t* bitmap = p;
+	const uint8_t* q;
+	void* list;
+	sge_value sv;
+	size_t i, len;
+
+	if (st->presence) {
+		if ((size_t)(end - p) < BITMAP_SIZE(block)) {
+			return NULL;
+		}
+		p += BITMAP_SIZE(block);
+	}
+	for (; p && code < last; ++code) {
+		keep = node ? node->fields[code->ordinal] : NULL;
+		if (st->presence && !FIELD_PRESENT(bitmap, code->ordinal)) {
+			if (keep && st->defaults == SGE_DEFAULTS_FILL) {
+				decode_default(code, ud, st);
+			}
+		} else if (NULL == keep || keep == &project_all) {
+			q = view_skip(code, code->opcode, st, p, end, depth);
+			if (q && keep) {
+				decode_present_field(code, ud, p, st);
+			}
+			p = q;
+		} else if (code->opcode == SGE_OP_CUSTOM) {
+			p = decode_projected_dict(code, keep, ud, p, end, st, -1, depth);
+		} else {
+			// every item takes at least a byte, a count past end is rejected before the list is sized by it
+			p = view_length(st->version, p, end, &len);
+			if (NULL == p || len > (size_t)(end - p)) {
+				return NULL;
+			}
+			sv = (sge_value)NEW_SGE_VALUE;
+			set_field(&sv, code);
+			sv.len = len;
+			sv.vt = SGE_LIST;
+			list = st->cb(ud, &sv);
+			for (i = 0; p && i < len; ++i) {
+				p = decode_projected_dict(code, keep, list, p, end, st, i, depth);
+			}
+		}
+	}
+	return p;
+}
+
+// frames of a block no path starts with make no calls, their check is still verified
+int
+sge_decode_projected(const char* buffer, size_t len, const sge_projection* proj, void* ud, field_set cb) {
+	const sge_projection_node* node = NULL;
+	const sge_block* block;
+	const uint8_t* body = (const uint8_t*)buffer + 6;
+	const uint8_t* p;
+	sge_decode_state st;
+	int integrity;
+	size_t i;
+
+	if (NULL == buffer || len < 6 || NULL == proj || NULL == ud || NULL == cb) {
+		return INVALID_PARAM;
+	}
+
+	if (proj->ctx->init == 0) {
+		return NOT_SCHEME;
+	}
+
+	block = frame_block(proj->ctx, (const uint8_t*)buffer, &integrity, &st);
+	if (NULL == block) {
+		return SGE_ERR;
+	}
+	if (integrity == SGE_INTEGRITY_CRC32C && len < 10) {
+		return INVALID_PARAM;
+	}
+	for (i = 0; i < proj->count; ++i) {
+		if (proj->roots[i]->block == block) {
+			node = proj->roots[i];
+			break;
+		}
+	}
+
+	st.cb = cb;
+	p = decode_projected_block(block, node, ud, body,
+		(const uint8_t*)buffer + len - (integrity == SGE_INTEGRITY_CRC32C ? 4 : 0), &st, 0);
+	if (NULL == p) {
+		SET_ERROR("bytes wrong format.");
+		return SGE_ERR;
+	}
+	if (SGE_OK != verify_checksum((const uint8_t*)buffer, p - body + 4, integrity)) {
+		SET_ERROR("invalid protocol");
+		return SGE_ERR;
 	}
+	return block->idx;
+}
 
-	sge_table_destroy(protocol.ht_name);
-	sge_table_destroy(protocol.ht_idx);
-	protocol.init = 0;
+void
+sge_destroy(int clean) {
+	clear_context(&protocol);
+	if (clean) {
+		sge_error_buffer()[0] = '\0';
+	}
 }
 
 void
-sge_print() {
+sge_ctx_print(const sge_context* ctx) {
 	sge_block* block;
 	sge_field* field;
 	sge_list* pb, *pf;
 
-	LIST_FOREACH(pb, &(protocol.block_head)) {
+	if (NULL == ctx || ctx->init == 0) {
+		return;
+	}
+
+	LIST_FOREACH(pb, &(ctx->block_head)) {
 		block = LIST_DATA(pb, sge_block, head);
 		printf("block name: %s, field size: %d\n", block->name, block->size);
 		LIST_FOREACH(pf, &(block->field_head)) {
 			field = LIST_DATA(pf, sge_field, head);
-			field->type->ops->print(field, 1);
+			field->type->print(field, 1);
 		}
 	}
 }
 
+void
+sge_print() {
+	sge_ctx_print(&protocol);
+}
+
 static const char* sge_error_str[] = {
 	"Success",
 	"Unknown error",
 	"Invalid Param",
 	"No such file or directory",
-	"NOT SCHEME"
+	"NOT SCHEME",
+	"Length overflow, use a wider wire version"
 };
 
 const char*
@@ -797,7 +3264,7 @@ sge_error(int code) {
 		return sge_error_str[1];
 	}
 	if (code == 1) {
-		return protocol.err;
+		return sge_error_buffer();
 	}
 	return sge_error_str[code];
 }
@@ -3,14 +3,155 @@
 
 #include "sge_define.h"
 
+#define SGE_OPT_INTEGRITY	1
+#define SGE_OPT_VERSION		2
+#define SGE_OPT_PRESENCE	3
+#define SGE_OPT_DEFAULTS	4
+
+#define SGE_VERSION_1	1	// fixed width integers, 16 bit lengths (default)
+#define SGE_VERSION_2	2	// zigzag LEB128 varint integers and lengths
+#define SGE_VERSION_3	3	// fixed width integers, 32 bit lengths
+
+#define SGE_INTEGRITY_CRC16		0	// 2 byte CRC-16 in front of the frame (default)
+#define SGE_INTEGRITY_NONE		1	// no check, for trusted in-process/IPC traffic
+#define SGE_INTEGRITY_CRC32C	2	// 4 byte CRC-32C after the body
+
+#define SGE_PRESENCE_NONE	0	// every field is written (default)
+#define SGE_PRESENCE_BITMAP	1	// a bitmap of the fields written leads each block, fields at their default are left out
+
+#define SGE_DEFAULTS_FILL	0	// fields left out of a frame get the calls a frame with them would make (default)
+#define SGE_DEFAULTS_SKIP	1	// fields left out of a frame get no calls
+
+#define SGE_DECODER_MORE	0	// every byte was used and the frame isn't complete yet
+#define SGE_DECODER_DONE	1	// a frame ended, the bytes after it belong to the next one
+
+typedef struct sge_context sge_context;
+typedef struct sge_decoder sge_decoder;
+typedef struct sge_view sge_view;
+typedef struct sge_projection sge_projection;
+
+// a resolved protocol, valid until its context is freed, destroyed or replaced by sge_live_publish
+typedef const struct sge_block* sge_block_handle;
+
+#define SGE_BATCH_HEADER_SIZE	13
+
+// sge_encode_packed encodes through a chunk of this many bytes, packing each as it fills, and sge_decode_packed
+// unpacks into one as the decoder needs it
+#define SGE_PACK_CHUNK_SIZE		512
+
+// sge_compress copies frames under SGE_STAGE_MIN_SIZE bytes as they are and tries LZ from SGE_STAGE_LZ_MIN_SIZE on
+#define SGE_STAGE_HEADER_SIZE	8
+#define SGE_STAGE_MIN_SIZE		64
+#define SGE_STAGE_LZ_MIN_SIZE	256
+#define SGE_STAGE_LZ_SAMPLE		4096
+#define SGE_COMPRESS_BOUND(len)	((len) + (len) / 8 + SGE_STAGE_HEADER_SIZE + 5)
+
+typedef struct sge_batch_item {
+	const char* name;
+	const void* ud;
+} sge_batch_item;
+
+// walks the messages of a batch checked by sge_decode_batch
+typedef struct sge_batch_iter {
+	const sge_context* ctx;
+	const char* cur;
+	const char* end;
+	int version;
+	int presence;
+	uint32_t left;
+} sge_batch_iter;
+
+// functions without a ctx argument work on one process wide context
 int sge_parse(const char* text);
 int sge_parse_file(const char* file);
+int sge_set_option(int option, int value);
+int sge_bind_fields(sge_bind_fn bind, void* ud);
 int sge_encode(const char* name, const void *ud, char* buffer, field_get cb);
+int sge_encode_n(const char* name, const void *ud, char* buffer, size_t capacity, field_get cb);
+int sge_encode_sink(const char* name, const void *ud, sge_sink* sink, field_get cb);
+int sge_encode_packed(const char* name, const void *ud, char* buffer, size_t capacity, field_get cb);
+int sge_encoded_size(const char* name, const void *ud, field_get cb);
+int sge_encoded_bound(const char* name, size_t* bound);
+sge_block_handle sge_block_find(const char* name);
+sge_block_handle sge_block_next(sge_block_handle prev);
+int sge_encode_h(sge_block_handle block, const void *ud, char* buffer, size_t capacity, field_get cb);
+int sge_encode_batch(const sge_batch_item* items, size_t count, char* buffer, size_t capacity, field_get cb);
 int sge_decode(const char* buffer, void* ud, field_set cb);
+int sge_decode_n(const char* buffer, size_t len, void* ud, field_set cb);
+int sge_decode_packed(const char* buffer, size_t len, void* ud, field_set cb);
+sge_block_handle sge_frame_block(const char* buffer);
+int sge_verify(const char* buffer, size_t len);
+int sge_decode_batch(const char* buffer, size_t len, sge_batch_iter* it);
+int sge_batch_next(sge_batch_iter* it, void* ud, field_set cb, uint32_t* proto_idx);
+sge_decoder* sge_decoder_new(void* ud, field_set cb);
+void sge_decoder_reset(sge_decoder* dec, void* ud);
+void sge_decoder_free(sge_decoder* dec);
+int sge_decoder_feed(sge_decoder* dec, const char* bytes, size_t len, size_t* used);
+uint32_t sge_decoder_proto(const sge_decoder* dec);
 int sge_pack(const char* in_str, int len, char* out_str);
 int sge_unpack(const char* in_str, int len, char* out_str);
+int sge_compress(const char* frame, size_t len, char* out);
+int sge_decompress(const char* in, size_t len, char* out, size_t capacity);
 void sge_destroy(int clean);
 void sge_print();
 const char* sge_error(int code);
 
+// a parsed context is read only: any number of threads may encode and decode with it at once,
+// parse and set options before sharing it
+sge_context* sge_ctx_new(void);
+void sge_ctx_free(sge_context* ctx);
+int sge_ctx_parse(sge_context* ctx, const char* text);
+int sge_ctx_parse_file(sge_context* ctx, const char* file);
+int sge_ctx_set_option(sge_context* ctx, int option, int value);
+int sge_ctx_bind_fields(sge_context* ctx, sge_bind_fn bind, void* ud);
+int sge_ctx_encode(const sge_context* ctx, const char* name, const void *ud, char* buffer, field_get cb);
+int sge_ctx_encode_n(const sge_context* ctx, const char* name, const void *ud, char* buffer, size_t capacity, field_get cb);
+int sge_ctx_encode_sink(const sge_context* ctx, const char* name, const void *ud, sge_sink* sink, field_get cb);
+int sge_ctx_encode_packed(const sge_context* ctx, const char* name, const void *ud, char* buffer, size_t capacity, field_get cb);
+int sge_ctx_encoded_size(const sge_context* ctx, const char* name, const void *ud, field_get cb);
+int sge_ctx_encoded_bound(const sge_context* ctx, const char* name, size_t* bound);
+sge_block_handle sge_ctx_block(const sge_context* ctx, const char* name);
+sge_block_handle sge_ctx_block_next(const sge_context* ctx, sge_block_handle prev);
+int sge_ctx_encode_batch(const sge_context* ctx, const sge_batch_item* items, size_t count, char* buffer, size_t capacity, field_get cb);
+int sge_ctx_decode(const sge_context* ctx, const char* buffer, void* ud, field_set cb);
+int sge_ctx_decode_n(const sge_context* ctx, const char* buffer, size_t len, void* ud, field_set cb);
+int sge_ctx_decode_packed(const sge_context* ctx, const char* buffer, size_t len, void* ud, field_set cb);
+sge_block_handle sge_ctx_frame_block(const sge_context* ctx, const char* buffer);
+int sge_ctx_decode_batch(const sge_context* ctx, const char* buffer, size_t len, sge_batch_iter* it);
+sge_decoder* sge_ctx_decoder_new(const sge_context* ctx, void* ud, field_set cb);
+sge_projection* sge_ctx_projection_new(const sge_context* ctx, const char* const* paths, size_t count);
+sge_view* sge_ctx_view_open(const sge_context* ctx, const char* buffer, size_t len);
+void sge_ctx_print(const sge_context* ctx);
+
+// schema introspection for bindings: walk the blocks with sge_block_next(NULL), sge_block_next(block), ...
+// sge_block_field describes field `ordinal` in a sge_value: name, name_len in len, slot, vt (SGE_LIST for any list,
+// SGE_DICT for a custom type) and ptr, the sge_block_handle of a custom type or NULL;
+// sge_frame_block tells which block an encoded frame holds before it is decoded
+const char* sge_block_name(sge_block_handle block);
+int sge_block_field(sge_block_handle block, uint32_t ordinal, sge_value* field);
+
+// decoding part of a frame: sge_projection_new compiles paths like "Person.name" and "Person.phone[].num" (the [] is
+// optional) against the schema, a path of a block alone keeps all of it. sge_decode_projected then makes the
+// sge_decode calls for the kept fields and the custom fields and lists on the way to them, the others are skipped by
+// their lengths. frames of other blocks make no calls; every read stays inside len and the check is verified
+// after the calls, as in sge_decode. a projection only reads the schema, any number of threads may use it at once
+sge_projection* sge_projection_new(const char* const* paths, size_t count);
+void sge_projection_free(sge_projection* proj);
+int sge_decode_projected(const char* buffer, size_t len, const sge_projection* proj, void* ud, field_set cb);
+
+// reading single fields of a frame without decoding it: sge_view_open takes the frame and its length, and a field asked
+// for by ordinal or name is found by skipping the ones before it, whose starts are kept for later lookups; the check
+// isn't read, sge_verify does that. fields come back as in sge_decode callbacks: a number as a long* in ptr, good until
+// the next call on the view, a string as ptr and len into the frame, a list with its item count in len (the items
+// through sge_view_item), a custom type with its sge_block_handle in ptr, NULL when it was left out.
+// sge_view_child opens custom field ordinal (idx -1) or item idx of a custom list as a view of its own, NULL when it
+// is absent or the bytes are bad. a view points into the frame and is freed with sge_view_free
+sge_view* sge_view_open(const char* buffer, size_t len);
+sge_view* sge_view_child(sge_view* view, uint32_t ordinal, int32_t idx);
+void sge_view_free(sge_view* view);
+sge_block_handle sge_view_block(const sge_view* view);
+int sge_view_field(sge_view* view, uint32_t ordinal, sge_value* value);
+int sge_view_get(sge_view* view, const char* name, sge_value* value);
+int sge_view_item(sge_view* view, uint32_t ordinal, size_t idx, sge_value* value);
+
 #endif
@@ -110,5 +110,6 @@ sge_table_destroy(sge_table* tbl) {
 			cur = next;
 		}
 	}
+	sge_free(tbl);
 }
 
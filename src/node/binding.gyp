@@ -9,7 +9,12 @@
 				"../core/sge_block.c",
 				"../core/sge_field.c",
 				"../core/sge_table.c",
-				"../core/sge_crc16.c"
+				"../core/sge_crc16.c",
+				"../core/sge_crc32c.c",
+				"../core/sge_live.c",
+				"../core/sge_index.c",
+				"../core/sge_pack.c",
+				"../core/sge_lz.c"
 			]
 		}
 	]
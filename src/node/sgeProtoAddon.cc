@@ -1,11 +1,16 @@
-#include <v8.h>
-#include <node.h>
+#include <node_api.h>
+#include <stdio.h>
+#include <string.h>
+#include <deque>
+#include <string>
+#include <vector>
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 #include "../core/sge_proto.h"
+#include "../core/sge_pack.h"
 #ifdef __cplusplus
 }
 #endif
@@ -13,95 +18,232 @@ extern "C"
 namespace sgeProto
 {
 
-using v8::Array;
-using v8::ArrayBuffer;
-using v8::Context;
-using v8::Exception;
-using v8::FunctionCallbackInfo;
-using v8::Isolate;
-using v8::Local;
-using v8::NewStringType;
-using v8::Number;
-using v8::Object;
-using v8::String;
-using v8::Uint8Array;
-using v8::Value;
+// output Uint8Arrays are views into shared slabs, a message bigger than half a slab gets an ArrayBuffer of its own
+static const size_t SLAB_SIZE = 64 * 1024;
+static const size_t SLAB_ALIGN = 8;
 
-static const uint16_t BUFFER_SIZE = 2048;
-static void* g_memPtr = NULL;
+typedef struct
+{
+	napi_ref ref;
+	char *data;
+	size_t used;
+} Slab;
 
-static void getData(const void *object, sge_value *ud)
+// the field callbacks only get the object, the rest of the call is kept here
+typedef struct
 {
-	Object *obj = (Object *)object;
-	Isolate *isolate = obj->GetIsolate();
-	Local<Context> context = isolate->GetCurrentContext();
-	const char *fieldName = ud->name;
-	Local<Value> key = String::NewFromUtf8(isolate, fieldName, NewStringType::kNormal).ToLocalChecked();
-	Local<Value> value;
+	napi_env env;
+	napi_value keys;
+	std::deque<std::string> str;	// UTF-8 copies of the strings read so far, each valid until the call ends
+	size_t strUsed;
+} CallState;
 
-	if (ud->idx == -1)
+// copies kept between calls, those longer than a slab are released
+static const size_t STR_KEEP = 64;
+
+// addon option, not passed to sge_set_option: inputs smaller than this many bytes skip the thread pool
+static const int OPT_ASYNC_THRESHOLD = 100;
+
+typedef enum
+{
+	WORK_PACK,
+	WORK_UNPACK,
+	WORK_VERIFY
+} WorkKind;
+
+// one packAsync/unpackAsync/verifyAsync call, the input is read where the caller keeps it
+typedef struct
+{
+	napi_async_work work;
+	napi_deferred deferred;
+	napi_ref input;
+	napi_ref output;
+	WorkKind kind;
+	const char *in;
+	size_t inLen;
+	char *out;
+	int ret;
+	std::string err;
+} AsyncCall;
+
+static Slab g_slab = {NULL, NULL, 0};
+static size_t g_asyncThreshold = 64 * 1024;
+static napi_ref g_keys = NULL;	// array of field name strings, the slot of a bound field is its index + 1
+static uint32_t g_keyCount = 0;
+static CallState g_call;
+static std::vector<std::string> g_projectionFields;	// the fields decode was last given, compiled into g_projection
+static sge_projection *g_projection = NULL;
+
+static void beginCall(napi_env env)
+{
+	g_call.env = env;
+	g_call.keys = NULL;
+	// with presence bitmaps every string of a block is read before any is written, so none can share a buffer
+	g_call.strUsed = 0;
+	if (g_call.str.size() > STR_KEEP)
+	{
+		g_call.str.resize(STR_KEEP);
+	}
+	for (std::string &str : g_call.str)
+	{
+		if (str.capacity() > SLAB_SIZE)
+		{
+			std::string().swap(str);
+		}
+	}
+	if (g_keys)
 	{
-		value = obj->Get(context, key).ToLocalChecked();
+		napi_get_reference_value(env, g_keys, &g_call.keys);
+	}
+}
+
+static void throwError(napi_env env, const char *msg)
+{
+	napi_throw_type_error(env, NULL, msg);
+}
+
+static napi_value fieldKey(const sge_value *ud)
+{
+	napi_env env = g_call.env;
+	napi_value key;
+
+	if (ud->slot && g_call.keys)
+	{
+		napi_get_element(env, g_call.keys, (uint32_t)((uintptr_t)ud->slot - 1), &key);
 	}
 	else
 	{
-		value = obj->Get(context, ud->idx).ToLocalChecked();
+		napi_create_string_utf8(env, ud->name, NAPI_AUTO_LENGTH, &key);
 	}
+	return key;
+}
+
+// every field keeps its key in the keys array, made once per schema
+static void *bindKey(void *slot, const char *name, size_t nameLen, void *ud)
+{
+	napi_env env = (napi_env)ud;
+	napi_value keys, key;
 
-	if (value.IsEmpty())
+	if (slot)
 	{
-		return;
+		return slot;
 	}
+	if (NULL == g_keys)
+	{
+		napi_create_array(env, &keys);
+		napi_create_reference(env, keys, 1, &g_keys);
+		g_keyCount = 0;
+	}
+	napi_get_reference_value(env, g_keys, &keys);
+	napi_create_string_utf8(env, name, nameLen, &key);
+	if (napi_ok != napi_set_element(env, keys, g_keyCount, key))
+	{
+		return NULL;
+	}
+	return (void *)(uintptr_t)++g_keyCount;
+}
 
-	if (value->IsNumber())
+static void *releaseKey(void *slot, const char *name, size_t nameLen, void *ud)
+{
+	return NULL;
+}
+
+// a failed parse clears the whole schema without visiting its fields, so they let go of their keys before every parse
+// and are bound again after it
+static void releaseKeys(napi_env env)
+{
+	sge_bind_fields(releaseKey, NULL);
+	if (g_keys)
 	{
-		*((long *)ud->ptr) = value->IntegerValue(context).ToChecked();
+		napi_delete_reference(env, g_keys);
+		g_keys = NULL;
+		g_keyCount = 0;
 	}
-	else if (value->IsString())
+}
+
+static void getData(const void *object, sge_value *ud)
+{
+	napi_env env = g_call.env;
+	napi_value obj = (napi_value)object;
+	napi_value value;
+	napi_valuetype type;
+	std::string *str;
+	bool isArray = false;
+	size_t len16 = 0;
+	uint32_t len = 0;
+	int64_t number = 0;
+
+	if (ud->idx == -1)
 	{
-		String *s = (String *)*value;
-		String::Utf8Value v8Value(isolate, value);
-		ud->len = s->Utf8Length(isolate);
-		memcpy(g_memPtr, *v8Value, ud->len);
-		ud->ptr = g_memPtr;
+		if (napi_ok != napi_get_property(env, obj, fieldKey(ud), &value))
+		{
+			return;
+		}
 	}
-	else if (value->IsArray())
+	else if (napi_ok != napi_get_element(env, obj, ud->idx, &value))
 	{
-		Local<Array> arr = value.As<Array>();
-		ud->ptr = *arr;
-		ud->len = arr->Length();
+		return;
 	}
-	else if (value->IsObject())
+
+	napi_typeof(env, value, &type);
+	switch (type)
 	{
-		Local<Object> oValue = value.As<Object>();
-		Isolate *oIsolate = oValue->GetIsolate();
-		Local<Context> oContext = oIsolate->GetCurrentContext();
-		Local<Array> keys = oValue->GetOwnPropertyNames(oContext).ToLocalChecked();
-		ud->len = keys->Length();
-		ud->ptr = *oValue;
+	case napi_number:
+		napi_get_value_int64(env, value, &number);
+		*((long *)ud->ptr) = (long)number;
+		break;
+	case napi_string:
+		if (g_call.strUsed == g_call.str.size())
+		{
+			g_call.str.emplace_back();
+		}
+		str = &g_call.str[g_call.strUsed++];
+		// a UTF-16 unit takes at most 3 UTF-8 bytes, so a single conversion always fits
+		napi_get_value_string_utf16(env, value, NULL, 0, &len16);
+		if (str->size() < len16 * 3 + 1)
+		{
+			str->resize(len16 * 3 + 1);
+		}
+		napi_get_value_string_utf8(env, value, &(*str)[0], str->size(), &ud->len);
+		ud->ptr = str->data();
+		break;
+	case napi_object:
+		napi_is_array(env, value, &isArray);
+		if (isArray)
+		{
+			napi_get_array_length(env, value, &len);
+			ud->len = len;
+		}
+		else
+		{
+			ud->len = 1;
+		}
+		ud->ptr = (void *)value;
+		break;
+	default:
+		break;
 	}
 }
 
 static void *setData(void *object, sge_value *ud)
 {
-	Object *obj = (Object *)object;
-	Isolate *isolate = obj->GetIsolate();
-	Local<Context> context = isolate->GetCurrentContext();
-	Local<Value> value, key;
+	napi_env env = g_call.env;
+	napi_value obj = (napi_value)object;
+	napi_value value = NULL;
 
 	switch (ud->vt)
 	{
 	case SGE_NUMBER:
-		value = Number::New(isolate, *((long *)ud->ptr));
+		napi_create_int64(env, *((long *)ud->ptr), &value);
 		break;
 	case SGE_STRING:
-		value = String::NewFromUtf8(isolate, (const char *)ud->ptr, NewStringType::kNormal, ud->len).ToLocalChecked();
+		napi_create_string_utf8(env, (const char *)ud->ptr, ud->len, &value);
 		break;
 	case SGE_LIST:
-		value = Array::New(isolate, ud->len);
+		napi_create_array_with_length(env, ud->len, &value);
 		break;
 	case SGE_DICT:
-		value = Object::New(isolate);
+		napi_create_object(env, &value);
 		break;
 	default:
 		break;
@@ -109,279 +251,902 @@ static void *setData(void *object, sge_value *ud)
 
 	if (ud->idx == -1)
 	{
-		key = String::NewFromUtf8(isolate, ud->name, NewStringType::kNormal).ToLocalChecked();
-		obj->Set(context, key, value);
+		napi_set_property(env, obj, fieldKey(ud), value);
 	}
 	else
 	{
-		Array *arr = (Array *)object;
-		arr->Set(context, ud->idx, value);
+		napi_set_element(env, obj, ud->idx, value);
 	}
 
-	return (void *)*value;
+	return (void *)value;
 }
 
-void parse(const FunctionCallbackInfo<Value> &args)
+// room for size bytes: the rest of the current slab, a new slab, or an ArrayBuffer of its own
+static char *slabReserve(napi_env env, size_t size, napi_value *arrayBuffer, size_t *offset)
 {
-	Isolate *isolate = args.GetIsolate();
+	napi_value slab;
+	void *data;
 
-	if (args.Length() < 1)
+	if (size > SLAB_SIZE / 2)
 	{
-		isolate->ThrowException(Exception::TypeError(
-			String::NewFromUtf8(isolate,
-								"argument 1 must be string",
-								NewStringType::kNormal)
-				.ToLocalChecked()));
-		return;
+		if (napi_ok != napi_create_arraybuffer(env, size, &data, arrayBuffer))
+		{
+			return NULL;
+		}
+		*offset = 0;
+		return (char *)data;
 	}
+	if (NULL == g_slab.ref || g_slab.used + size > SLAB_SIZE)
+	{
+		if (napi_ok != napi_create_arraybuffer(env, SLAB_SIZE, &data, &slab))
+		{
+			return NULL;
+		}
+		// the views already handed out keep the old slab alive
+		if (g_slab.ref)
+		{
+			napi_delete_reference(env, g_slab.ref);
+		}
+		napi_create_reference(env, slab, 1, &g_slab.ref);
+		g_slab.data = (char *)data;
+		g_slab.used = 0;
+	}
+	napi_get_reference_value(env, g_slab.ref, arrayBuffer);
+	*offset = g_slab.used;
+	return g_slab.data + g_slab.used;
+}
+
+// hand out the first size reserved bytes as a Uint8Array
+static napi_value slabCommit(napi_env env, napi_value arrayBuffer, const char *out, size_t offset, size_t size)
+{
+	napi_value ret;
 
-	if (!args[0]->IsString())
+	if (g_slab.ref && out == g_slab.data + g_slab.used)
 	{
-		isolate->ThrowException(Exception::TypeError(
-			String::NewFromUtf8(isolate,
-								"argument 1 must be string",
-								NewStringType::kNormal)
-				.ToLocalChecked()));
-		return;
+		g_slab.used = (offset + size + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1);
 	}
+	napi_create_typedarray(env, napi_uint8_array, size, arrayBuffer, offset, &ret);
+	return ret;
+}
 
-	String::Utf8Value textObj(isolate, args[0]);
-	char *text = *textObj;
+// the bytes of a TypedArray, DataView or ArrayBuffer
+static bool getBytes(napi_env env, napi_value value, char **data, size_t *len)
+{
+	bool is = false;
+	napi_typedarray_type type;
+	size_t count, offset;
+	napi_value arrayBuffer;
 
-	if (sge_parse(text) != SGE_OK)
+	napi_is_typedarray(env, value, &is);
+	if (is)
 	{
-		isolate->ThrowException(Exception::TypeError(
-			String::NewFromUtf8(isolate,
-								"parse protocol fail.",
-								NewStringType::kNormal)
-				.ToLocalChecked()));
-		return;
+		napi_get_typedarray_info(env, value, &type, &count, (void **)data, &arrayBuffer, &offset);
+		switch (type)
+		{
+		case napi_int8_array:
+		case napi_uint8_array:
+		case napi_uint8_clamped_array:
+			*len = count;
+			break;
+		case napi_int16_array:
+		case napi_uint16_array:
+			*len = count * 2;
+			break;
+		case napi_float64_array:
+		case napi_bigint64_array:
+		case napi_biguint64_array:
+			*len = count * 8;
+			break;
+		default:
+			*len = count * 4;
+			break;
+		}
+		return true;
+	}
+	napi_is_dataview(env, value, &is);
+	if (is)
+	{
+		napi_get_dataview_info(env, value, len, (void **)data, &arrayBuffer, &offset);
+		return true;
+	}
+	napi_is_arraybuffer(env, value, &is);
+	if (is)
+	{
+		napi_get_arraybuffer_info(env, value, (void **)data, len);
+		return true;
 	}
+	return false;
 }
 
-void parseFile(const FunctionCallbackInfo<Value> &args)
+static bool getString(napi_env env, napi_value value, std::string &out)
 {
-	Isolate *isolate = args.GetIsolate();
+	size_t len = 0;
+	napi_valuetype type;
 
-	if (args.Length() < 1)
+	napi_typeof(env, value, &type);
+	if (type != napi_string)
 	{
-		isolate->ThrowException(Exception::TypeError(
-			String::NewFromUtf8(isolate,
-								"argument 1 must be string",
-								NewStringType::kNormal)
-				.ToLocalChecked()));
-		return;
+		return false;
+	}
+	napi_get_value_string_utf8(env, value, NULL, 0, &len);
+	out.resize(len);
+	napi_get_value_string_utf8(env, value, &out[0], len + 1, &len);
+	return true;
+}
+
+static bool isObject(napi_env env, napi_value value)
+{
+	napi_valuetype type;
+	napi_typeof(env, value, &type);
+	return type == napi_object;
+}
+
+static bool getBool(napi_env env, napi_value value)
+{
+	bool ret = false;
+	napi_value b;
+	napi_coerce_to_bool(env, value, &b);
+	napi_get_value_bool(env, b, &ret);
+	return ret;
+}
+
+static napi_value makePair(napi_env env, uint32_t protoIdx, napi_value obj)
+{
+	napi_value ret, idx;
+
+	napi_create_array_with_length(env, 2, &ret);
+	napi_create_uint32(env, protoIdx, &idx);
+	napi_set_element(env, ret, 0, idx);
+	napi_set_element(env, ret, 1, obj);
+	return ret;
+}
+
+static void clearProjection()
+{
+	sge_projection_free(g_projection);
+	g_projection = NULL;
+	g_projectionFields.clear();
+}
+
+// the projection for an array of 'Block.field' paths, kept until the paths or the schema change
+static sge_projection *getProjection(napi_env env, napi_value value)
+{
+	bool isArray = false;
+	uint32_t count = 0;
+	napi_value item;
+	std::vector<std::string> fields;
+	std::vector<const char *> paths;
+
+	napi_is_array(env, value, &isArray);
+	if (!isArray)
+	{
+		throwError(env, "argument 2 must be an array of field paths.");
+		return NULL;
+	}
+	napi_get_array_length(env, value, &count);
+	fields.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		napi_get_element(env, value, i, &item);
+		if (!getString(env, item, fields[i]))
+		{
+			throwError(env, "argument 2 must be an array of field paths.");
+			return NULL;
+		}
+	}
+	if (g_projection && fields == g_projectionFields)
+	{
+		return g_projection;
 	}
 
-	if (!args[0]->IsString())
+	clearProjection();
+	for (uint32_t i = 0; i < count; i++)
 	{
-		isolate->ThrowException(Exception::TypeError(
-			String::NewFromUtf8(isolate,
-								"argument 1 must be string",
-								NewStringType::kNormal)
-				.ToLocalChecked()));
-		return;
+		paths.push_back(fields[i].c_str());
+	}
+	g_projection = sge_projection_new(paths.data(), count);
+	if (!g_projection)
+	{
+		throwError(env, sge_error(SGE_ERR));
+		return NULL;
 	}
+	g_projectionFields.swap(fields);
+	return g_projection;
+}
 
-	String::Utf8Value fileNameObj(isolate, args[0]);
-	const char *fileName = *fileNameObj;
-	if (sge_parse_file(fileName) != SGE_OK)
+static napi_value parse(napi_env env, napi_callback_info info)
+{
+	size_t argc = 1;
+	napi_value argv[1];
+	std::string text;
+
+	napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+	if (argc < 1 || !getString(env, argv[0], text))
 	{
-		isolate->ThrowException(Exception::TypeError(
-			String::NewFromUtf8(isolate,
-								"parse file fail.",
-								NewStringType::kNormal)
-				.ToLocalChecked()));
-		return;
+		throwError(env, "argument 1 must be string");
+		return NULL;
 	}
+
+	clearProjection();
+	releaseKeys(env);
+	int ret = sge_parse(text.c_str());
+	sge_bind_fields(bindKey, env);
+	if (ret != SGE_OK)
+	{
+		throwError(env, "parse protocol fail.");
+	}
+	return NULL;
 }
 
-void encode(const FunctionCallbackInfo<Value> &args)
+static napi_value parseFile(napi_env env, napi_callback_info info)
 {
-	Isolate *isolate = args.GetIsolate();
-	Local<Context> context = isolate->GetCurrentContext();
+	size_t argc = 1;
+	napi_value argv[1];
+	std::string fileName;
 
-	if (args.Length() < 2)
+	napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+	if (argc < 1 || !getString(env, argv[0], fileName))
 	{
-		isolate->ThrowException(Exception::TypeError(
-			String::NewFromUtf8(isolate,
-								"argument error.",
-								NewStringType::kNormal)
-				.ToLocalChecked()));
-		return;
+		throwError(env, "argument 1 must be string");
+		return NULL;
 	}
 
-	if (!args[0]->IsString())
+	clearProjection();
+	releaseKeys(env);
+	int ret = sge_parse_file(fileName.c_str());
+	sge_bind_fields(bindKey, env);
+	if (ret != SGE_OK)
 	{
-		isolate->ThrowException(Exception::TypeError(
-			String::NewFromUtf8(isolate,
-								"argument 1 must be string.",
-								NewStringType::kNormal)
-				.ToLocalChecked()));
-		return;
+		throwError(env, "parse file fail.");
 	}
+	return NULL;
+}
 
-	if (!args[1]->IsObject())
+static napi_value encode(napi_env env, napi_callback_info info)
+{
+	size_t argc = 2;
+	napi_value argv[2];
+	napi_value arrayBuffer;
+	std::string protoName;
+	size_t offset = 0;
+	char *out;
+	int len;
+
+	napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+	if (argc < 2 || !getString(env, argv[0], protoName))
 	{
-		isolate->ThrowException(Exception::TypeError(
-			String::NewFromUtf8(isolate,
-								"argument 1 must be object.",
-								NewStringType::kNormal)
-				.ToLocalChecked()));
-		return;
+		throwError(env, "argument 1 must be string.");
+		return NULL;
+	}
+	if (!isObject(env, argv[1]))
+	{
+		throwError(env, "argument 2 must be object.");
+		return NULL;
 	}
 
-	String::Utf8Value protoNameObj(isolate, args[0]);
-	Local<Object> userStruct = args[1]->ToObject(context).ToLocalChecked();
-	Local<ArrayBuffer> buffer = ArrayBuffer::New(isolate, BUFFER_SIZE);
-	int len = 0;
-	const char *protoName = *protoNameObj;
-	const void *userData = (const void *)*userStruct;
-	char *pBuffer = (char *)buffer->GetContents().Data();
-	len = sge_encode(protoName, userData, pBuffer, getData);
-	if (len < 0)
+	beginCall(env);
+	// most messages fit in what is left of the slab
+	out = slabReserve(env, 0, &arrayBuffer, &offset);
+	if (NULL == out)
 	{
-		isolate->ThrowException(Exception::TypeError(
-			String::NewFromUtf8(isolate,
-								"encode fail.",
-								NewStringType::kNormal)
-				.ToLocalChecked()));
-		return;
+		throwError(env, "out of memory.");
+		return NULL;
+	}
+	len = sge_encode_n(protoName.c_str(), argv[1], out, SLAB_SIZE - offset, getData);
+	if (len > 0 && (size_t)len > SLAB_SIZE - offset)
+	{
+		out = slabReserve(env, len, &arrayBuffer, &offset);
+		if (NULL == out || len != sge_encode_n(protoName.c_str(), argv[1], out, len, getData))
+		{
+			len = SGE_ERR;
+		}
 	}
-	Local<Uint8Array> u8Arr = Uint8Array::New(buffer, 0, len);
-	args.GetReturnValue().Set(u8Arr);
+	if (len <= 0)
+	{
+		throwError(env, len < 0 ? sge_error(len) : "encode fail.");
+		return NULL;
+	}
+	return slabCommit(env, arrayBuffer, out, offset, len);
 }
 
-void decode(const FunctionCallbackInfo<Value> &args)
+// encodeInto(name, obj, buffer, offset = 0) returns the bytes written
+static napi_value encodeInto(napi_env env, napi_callback_info info)
 {
-	Isolate *isolate = args.GetIsolate();
+	size_t argc = 4;
+	napi_value argv[4];
+	napi_value ret;
+	std::string protoName;
+	char *data = NULL;
+	size_t len = 0;
+	int64_t offset = 0;
+	int size;
+	char msg[128];
 
-	if (args.Length() < 1)
+	napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+	if (argc < 3 || !getString(env, argv[0], protoName) || !isObject(env, argv[1]) || !getBytes(env, argv[2], &data, &len))
 	{
-		isolate->ThrowException(Exception::TypeError(
-			String::NewFromUtf8(isolate,
-								"argument error.",
-								NewStringType::kNormal)
-				.ToLocalChecked()));
-		return;
+		throwError(env, "arguments must be (string, object, buffer[, offset]).");
+		return NULL;
+	}
+	if (argc > 3 && napi_ok != napi_get_value_int64(env, argv[3], &offset))
+	{
+		throwError(env, "argument 4 must be number.");
+		return NULL;
+	}
+	if (offset < 0 || (size_t)offset > len)
+	{
+		napi_throw_range_error(env, NULL, "offset out of the buffer.");
+		return NULL;
 	}
 
-	if (!args[0]->IsUint8Array())
+	beginCall(env);
+	size = sge_encode_n(protoName.c_str(), argv[1], data + offset, len - offset, getData);
+	if (size <= 0)
 	{
-		isolate->ThrowException(Exception::TypeError(
-			String::NewFromUtf8(isolate,
-								"argument 1 must be ArrayBuffer.",
-								NewStringType::kNormal)
-				.ToLocalChecked()));
-		return;
+		throwError(env, size < 0 ? sge_error(size) : "encode fail.");
+		return NULL;
+	}
+	if ((size_t)size > len - offset)
+	{
+		snprintf(msg, sizeof(msg), "%s needs %d bytes, %zu left.", protoName.c_str(), size, len - (size_t)offset);
+		napi_throw_range_error(env, NULL, msg);
+		return NULL;
+	}
+	napi_create_int32(env, size, &ret);
+	return ret;
+}
+
+// a frame, or with packed the output of pack, decoded as it is unpacked; decode(u8arr, [paths]) decodes only those
+static napi_value decodeCall(napi_env env, napi_callback_info info, bool packed)
+{
+	size_t argc = 2;
+	napi_value argv[2];
+	napi_value obj;
+	napi_valuetype type = napi_undefined;
+	sge_projection *proj = NULL;
+	char *buffer = NULL;
+	size_t len = 0;
+	int protoIdx;
+
+	napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+	if (argc < 1 || !getBytes(env, argv[0], &buffer, &len))
+	{
+		throwError(env, "argument 1 must be Uint8Array.");
+		return NULL;
+	}
+	if (packed ? len < 1 : len < 6)
+	{
+		throwError(env, "bytes wrong format.");
+		return NULL;
+	}
+	if (!packed && argc > 1)
+	{
+		napi_typeof(env, argv[1], &type);
+	}
+	if (type != napi_undefined && type != napi_null && !(proj = getProjection(env, argv[1])))
+	{
+		return NULL;
+	}
+
+	beginCall(env);
+	napi_create_object(env, &obj);
+	if (packed)
+	{
+		protoIdx = sge_decode_packed(buffer, len, (void *)obj, setData);
+	}
+	else if (proj)
+	{
+		protoIdx = sge_decode_projected(buffer, len, proj, (void *)obj, setData);
+	}
+	else
+	{
+		protoIdx = sge_decode_n(buffer, len, (void *)obj, setData);
+	}
+	if (protoIdx < 0)
+	{
+		throwError(env, sge_error(protoIdx));
+		return NULL;
+	}
+	return makePair(env, protoIdx, obj);
+}
+
+static napi_value decode(napi_env env, napi_callback_info info)
+{
+	return decodeCall(env, info, false);
+}
+
+static napi_value decodePacked(napi_env env, napi_callback_info info)
+{
+	return decodeCall(env, info, true);
+}
+
+static napi_value setOption(napi_env env, napi_callback_info info)
+{
+	size_t argc = 2;
+	napi_value argv[2];
+	int32_t option = 0, value = 0;
+
+	napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+	if (argc < 2 || napi_ok != napi_get_value_int32(env, argv[0], &option) ||
+		napi_ok != napi_get_value_int32(env, argv[1], &value))
+	{
+		throwError(env, "argument 1 and 2 must be number.");
+		return NULL;
 	}
 
-	Local<Context> context = isolate->GetCurrentContext();
-	Local<Uint8Array> u8Arr = args[0].As<Uint8Array>();
-	Local<ArrayBuffer> arr = u8Arr->Buffer();
-	Local<Object> obj = Object::New(isolate);
-	const char *buffer = (const char *)arr->GetContents().Data();
-	void *userData = (void *)*obj;
-	int protoIdx = sge_decode(buffer, userData, setData);
-	Local<Array> ret = Array::New(isolate, 2);
-	Local<Number> protoIdxObj = Number::New(isolate, protoIdx);
-	ret->Set(context, Number::New(isolate, 0), protoIdxObj);
-	ret->Set(context, Number::New(isolate, 1), obj);
+	if (option == OPT_ASYNC_THRESHOLD)
+	{
+		if (value < 0)
+		{
+			napi_throw_range_error(env, NULL, "invalid option or value.");
+			return NULL;
+		}
+		g_asyncThreshold = value;
+		return NULL;
+	}
+	if (sge_set_option(option, value) != SGE_OK)
+	{
+		napi_throw_range_error(env, NULL, "invalid option or value.");
+	}
+	return NULL;
+}
 
-	args.GetReturnValue().Set(ret);
+static void setConstant(napi_env env, napi_value exports, const char *name, int value)
+{
+	napi_value v;
+	napi_create_int32(env, value, &v);
+	napi_set_named_property(env, exports, name, v);
 }
 
-void destroy(const FunctionCallbackInfo<Value> &args)
+static napi_value destroy(napi_env env, napi_callback_info info)
 {
+	releaseKeys(env);
+	clearProjection();
 	sge_destroy(1);
+	return NULL;
 }
 
-void debug(const FunctionCallbackInfo<Value> &args)
+static napi_value debug(napi_env env, napi_callback_info info)
 {
 	sge_print();
+	return NULL;
 }
 
-void pack(const FunctionCallbackInfo<Value> &args) {
-	Isolate *isolate = args.GetIsolate();
+// every group spread to 8 bytes, the zeros sge_unpack leaves off the last one included, so a frame that ends in zero
+// bytes decodes from the result; at most len * 8 bytes
+static int unpackGroups(const char *in, size_t len, char *out)
+{
+	size_t groups = SIZE_MAX;
 
-	if (args.Length() < 1) {
-		isolate->ThrowException(Exception::TypeError(
-			String::NewFromUtf8(isolate,
-								"argument error.",
-								NewStringType::kNormal)
-				.ToLocalChecked()));
-		return;
+	return sge_unpack_groups(in, in + len, out, &groups) ? (int)(groups * 8) : INVALID_PARAM;
+}
+
+// sge_pack writes at most len + len / 8 + 1 bytes, unpackGroups at most len * 8
+static napi_value packCall(napi_env env, napi_callback_info info, bool doPack)
+{
+	size_t argc = 1;
+	napi_value argv[1];
+	napi_value arrayBuffer;
+	char *code = NULL, *out;
+	size_t codeLen = 0, offset = 0, bound;
+	int len;
+
+	napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+	if (argc < 1 || !getBytes(env, argv[0], &code, &codeLen))
+	{
+		throwError(env, "argument 1 must be Uint8Array.");
+		return NULL;
+	}
+	if (codeLen == 0 || codeLen > INT32_MAX / 8)
+	{
+		napi_throw_range_error(env, NULL, "invalid length.");
+		return NULL;
 	}
 
-	if (!args[0]->IsUint8Array()) {
-		isolate->ThrowException(Exception::TypeError(
-			String::NewFromUtf8(isolate,
-								"argument 1 must be ArrayBuffer.",
-								NewStringType::kNormal)
-				.ToLocalChecked()));
-		return;
+	bound = doPack ? codeLen + codeLen / 8 + 1 : codeLen * 8;
+	out = slabReserve(env, bound, &arrayBuffer, &offset);
+	if (NULL == out)
+	{
+		throwError(env, "out of memory.");
+		return NULL;
+	}
+	len = doPack ? sge_pack(code, codeLen, out) : unpackGroups(code, codeLen, out);
+	if (len < 0)
+	{
+		throwError(env, sge_error(len));
+		return NULL;
 	}
+	return slabCommit(env, arrayBuffer, out, offset, len);
+}
 
-	int len = 0;
-	Local<Uint8Array> codeArr = args[0].As<Uint8Array>();
-	Local<ArrayBuffer> arr = codeArr->Buffer();
-	const char* code = (const char*)arr->GetContents().Data();
-	int codeLen = codeArr->Length();
-	Local<ArrayBuffer> buffer = ArrayBuffer::New(isolate, BUFFER_SIZE);
-	char *pBuffer = (char *)buffer->GetContents().Data();
-	len = sge_pack(code, codeLen, pBuffer);
+static napi_value pack(napi_env env, napi_callback_info info)
+{
+	return packCall(env, info, true);
+}
 
-	Local<Uint8Array> u8Arr = Uint8Array::New(buffer, 0, len);
-	args.GetReturnValue().Set(u8Arr);
+static napi_value unpack(napi_env env, napi_callback_info info)
+{
+	return packCall(env, info, false);
 }
 
-void unpack(const FunctionCallbackInfo<Value> &args) {
-	Isolate *isolate = args.GetIsolate();
+static napi_value compress(napi_env env, napi_callback_info info)
+{
+	size_t argc = 1;
+	napi_value argv[1];
+	napi_value arrayBuffer;
+	char *frame = NULL, *out;
+	size_t frameLen = 0, offset = 0;
+	int len;
 
-	if (args.Length() < 1) {
-		isolate->ThrowException(Exception::TypeError(
-			String::NewFromUtf8(isolate,
-								"argument error.",
-								NewStringType::kNormal)
-				.ToLocalChecked()));
-		return;
+	napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+	if (argc < 1 || !getBytes(env, argv[0], &frame, &frameLen))
+	{
+		throwError(env, "argument 1 must be Uint8Array.");
+		return NULL;
+	}
+	if (frameLen > INT32_MAX / 2)
+	{
+		napi_throw_range_error(env, NULL, "invalid length.");
+		return NULL;
 	}
 
-	if (!args[0]->IsUint8Array()) {
-		isolate->ThrowException(Exception::TypeError(
-			String::NewFromUtf8(isolate,
-								"argument 1 must be ArrayBuffer.",
-								NewStringType::kNormal)
-				.ToLocalChecked()));
-		return;
+	out = slabReserve(env, SGE_COMPRESS_BOUND(frameLen), &arrayBuffer, &offset);
+	if (NULL == out)
+	{
+		throwError(env, "out of memory.");
+		return NULL;
+	}
+	len = sge_compress(frame, frameLen, out);
+	if (len < 0)
+	{
+		throwError(env, sge_error(len));
+		return NULL;
+	}
+	return slabCommit(env, arrayBuffer, out, offset, len);
+}
+
+// the header of a compressed frame tells its size
+static napi_value decompress(napi_env env, napi_callback_info info)
+{
+	size_t argc = 1;
+	napi_value argv[1];
+	napi_value arrayBuffer;
+	char *code = NULL, *out;
+	size_t codeLen = 0, offset = 0;
+	int len;
+
+	napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+	if (argc < 1 || !getBytes(env, argv[0], &code, &codeLen))
+	{
+		throwError(env, "argument 1 must be Uint8Array.");
+		return NULL;
+	}
+
+	len = sge_decompress(code, codeLen, NULL, 0);
+	if (len < 0)
+	{
+		throwError(env, sge_error(len));
+		return NULL;
+	}
+	out = slabReserve(env, len, &arrayBuffer, &offset);
+	if (NULL == out)
+	{
+		throwError(env, "out of memory.");
+		return NULL;
+	}
+	len = sge_decompress(code, codeLen, out, len);
+	if (len < 0)
+	{
+		throwError(env, sge_error(len));
+		return NULL;
+	}
+	return slabCommit(env, arrayBuffer, out, offset, len);
+}
+
+// touches no napi state, runs on a libuv worker
+static void runAsyncCall(napi_env env, void *data)
+{
+	AsyncCall *call = (AsyncCall *)data;
+
+	switch (call->kind)
+	{
+	case WORK_PACK:
+		call->ret = sge_pack(call->in, call->inLen, call->out);
+		break;
+	case WORK_UNPACK:
+		call->ret = unpackGroups(call->in, call->inLen, call->out);
+		break;
+	default:
+		call->ret = sge_verify(call->in, call->inLen);
+		break;
+	}
+	if (call->ret < 0 && call->kind != WORK_VERIFY)
+	{
+		call->err = sge_error(call->ret);
+	}
+}
+
+static void settleAsyncCall(napi_env env, napi_status status, void *data)
+{
+	AsyncCall *call = (AsyncCall *)data;
+	napi_value result, arrayBuffer, msg;
+
+	if (call->kind == WORK_VERIFY)
+	{
+		napi_get_boolean(env, call->ret == SGE_OK, &result);
+		napi_resolve_deferred(env, call->deferred, result);
+	}
+	else if (status != napi_ok || call->ret < 0)
+	{
+		napi_create_string_utf8(env, call->err.empty() ? "async work cancelled." : call->err.c_str(), NAPI_AUTO_LENGTH, &msg);
+		napi_create_error(env, NULL, msg, &result);
+		napi_reject_deferred(env, call->deferred, result);
+	}
+	else
+	{
+		napi_get_reference_value(env, call->output, &arrayBuffer);
+		napi_create_typedarray(env, napi_uint8_array, call->ret, arrayBuffer, 0, &result);
+		napi_resolve_deferred(env, call->deferred, result);
 	}
 
-	int len = 0;
-	Local<Uint8Array> codeArr = args[0].As<Uint8Array>();
-	Local<ArrayBuffer> arr = codeArr->Buffer();
-	const char *code = (const char *)arr->GetContents().Data();
-	int codeLen = codeArr->Length();
-	Local<ArrayBuffer> buffer = ArrayBuffer::New(isolate, BUFFER_SIZE);
-	char *pBuffer = (char *)buffer->GetContents().Data();
-	len = sge_unpack(code, codeLen, pBuffer);
-	Local<Uint8Array> u8Arr = Uint8Array::New(buffer, 0, len);
+	napi_delete_reference(env, call->input);
+	if (call->output)
+	{
+		napi_delete_reference(env, call->output);
+	}
+	if (call->work)
+	{
+		napi_delete_async_work(env, call->work);
+	}
+	delete call;
+}
+
+// a promise for the work, which runs right here when the input is under the threshold
+static napi_value asyncCall(napi_env env, napi_callback_info info, WorkKind kind)
+{
+	size_t argc = 1;
+	napi_value argv[1];
+	napi_value promise, arrayBuffer, name;
+	char *in = NULL;
+	void *out = NULL;
+	size_t inLen = 0, bound = 0;
+	AsyncCall *call;
+
+	napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+	if (argc < 1 || !getBytes(env, argv[0], &in, &inLen))
+	{
+		throwError(env, "argument 1 must be Uint8Array.");
+		return NULL;
+	}
+	if (kind != WORK_VERIFY && (inLen == 0 || inLen > INT32_MAX / 8))
+	{
+		napi_throw_range_error(env, NULL, "invalid length.");
+		return NULL;
+	}
 
-	args.GetReturnValue().Set(u8Arr);
+	call = new AsyncCall();
+	call->kind = kind;
+	call->in = in;
+	call->inLen = inLen;
+	napi_create_reference(env, argv[0], 1, &call->input);
+	if (kind != WORK_VERIFY)
+	{
+		bound = kind == WORK_PACK ? inLen + inLen / 8 + 1 : inLen * 8;
+		if (napi_ok != napi_create_arraybuffer(env, bound, &out, &arrayBuffer))
+		{
+			napi_delete_reference(env, call->input);
+			delete call;
+			throwError(env, "out of memory.");
+			return NULL;
+		}
+		call->out = (char *)out;
+		napi_create_reference(env, arrayBuffer, 1, &call->output);
+	}
+	napi_create_promise(env, &call->deferred, &promise);
+
+	if (inLen < g_asyncThreshold)
+	{
+		runAsyncCall(env, call);
+		settleAsyncCall(env, napi_ok, call);
+		return promise;
+	}
+	napi_create_string_utf8(env, "sgeProto", NAPI_AUTO_LENGTH, &name);
+	napi_create_async_work(env, NULL, name, runAsyncCall, settleAsyncCall, call, &call->work);
+	napi_queue_async_work(env, call->work);
+	return promise;
+}
+
+static napi_value packAsync(napi_env env, napi_callback_info info)
+{
+	return asyncCall(env, info, WORK_PACK);
+}
+
+static napi_value unpackAsync(napi_env env, napi_callback_info info)
+{
+	return asyncCall(env, info, WORK_UNPACK);
+}
+
+static napi_value verifyAsync(napi_env env, napi_callback_info info)
+{
+	return asyncCall(env, info, WORK_VERIFY);
 }
 
-void Initialize(Local<Object> exports)
+static napi_value encodeBatch(napi_env env, napi_callback_info info)
 {
-	g_memPtr = malloc(sizeof(char) * BUFFER_SIZE);
-	NODE_SET_METHOD(exports, "parse", parse);
-	NODE_SET_METHOD(exports, "parseFile", parseFile);
-	NODE_SET_METHOD(exports, "encode", encode);
-	NODE_SET_METHOD(exports, "decode", decode);
-	NODE_SET_METHOD(exports, "destroy", destroy);
-	NODE_SET_METHOD(exports, "debug", debug);
-	NODE_SET_METHOD(exports, "pack", pack);
-	NODE_SET_METHOD(exports, "unpack", unpack);
+	size_t argc = 2;
+	napi_value argv[2];
+	napi_value arrayBuffer;
+	bool isArray = false;
+	uint32_t count = 0, itemLen = 0;
+	size_t offset = 0;
+	char *out;
+
+	napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+	if (argc >= 1)
+	{
+		napi_is_array(env, argv[0], &isArray);
+	}
+	if (!isArray)
+	{
+		throwError(env, "argument 1 must be array of [name, object].");
+		return NULL;
+	}
+
+	bool doPack = argc > 1 && getBool(env, argv[1]);
+	napi_get_array_length(env, argv[0], &count);
+	std::vector<std::string> names(count);
+	std::vector<sge_batch_item> items(count);
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		napi_value item, name, object;
+		napi_get_element(env, argv[0], i, &item);
+		napi_is_array(env, item, &isArray);
+		if (isArray)
+		{
+			napi_get_array_length(env, item, &itemLen);
+		}
+		if (!isArray || itemLen != 2)
+		{
+			throwError(env, "batch item must be [name, object].");
+			return NULL;
+		}
+		napi_get_element(env, item, 0, &name);
+		napi_get_element(env, item, 1, &object);
+		if (!getString(env, name, names[i]) || !isObject(env, object))
+		{
+			throwError(env, "batch item must be [name, object].");
+			return NULL;
+		}
+		items[i].name = names[i].c_str();
+		items[i].ud = (const void *)object;
+	}
+
+	beginCall(env);
+	const sge_batch_item *pItems = count ? &items[0] : NULL;
+	int len = sge_encode_batch(pItems, count, NULL, 0, getData);
+	if (len < 0)
+	{
+		throwError(env, sge_error(len));
+		return NULL;
+	}
+
+	size_t bound = doPack ? len + len / 8 + 1 : len;
+	std::vector<char> frame(doPack ? len : 0);
+	out = slabReserve(env, bound, &arrayBuffer, &offset);
+	if (NULL == out)
+	{
+		throwError(env, "out of memory.");
+		return NULL;
+	}
+	if (len != sge_encode_batch(pItems, count, doPack ? &frame[0] : out, len, getData))
+	{
+		throwError(env, "encode fail.");
+		return NULL;
+	}
+	if (doPack)
+	{
+		len = sge_pack(&frame[0], len, out);
+	}
+	return slabCommit(env, arrayBuffer, out, offset, len);
+}
+
+static napi_value decodeBatch(napi_env env, napi_callback_info info)
+{
+	size_t argc = 2;
+	napi_value argv[2];
+	napi_value ret;
+	char *data = NULL;
+	size_t len = 0;
+
+	napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+	if (argc < 1 || !getBytes(env, argv[0], &data, &len))
+	{
+		throwError(env, "argument 1 must be Uint8Array.");
+		return NULL;
+	}
+
+	bool doUnpack = argc > 1 && getBool(env, argv[1]);
+	const char *buffer = data;
+	std::vector<char> unpacked;
+
+	if (doUnpack && len)
+	{
+		// sge_unpack drops trailing zero bytes, decode from the zero filled upper bound
+		unpacked.assign(len * 8, 0);
+		sge_unpack(buffer, len, &unpacked[0]);
+		buffer = &unpacked[0];
+		len = unpacked.size();
+	}
+
+	sge_batch_iter it;
+	int count = sge_decode_batch(buffer, len, &it);
+	if (count < 0)
+	{
+		throwError(env, sge_error(count));
+		return NULL;
+	}
+
+	beginCall(env);
+	napi_create_array_with_length(env, count, &ret);
+	for (int i = 0; i < count; ++i)
+	{
+		uint32_t protoIdx = 0;
+		napi_value obj;
+		napi_create_object(env, &obj);
+		int r = sge_batch_next(&it, (void *)obj, setData, &protoIdx);
+		if (r != 1)
+		{
+			throwError(env, sge_error(r < 0 ? r : SGE_ERR));
+			return NULL;
+		}
+		napi_set_element(env, ret, i, makePair(env, protoIdx, obj));
+	}
+	return ret;
+}
+
+static napi_value Init(napi_env env, napi_value exports)
+{
+	napi_property_descriptor methods[] = {
+		{"parse", NULL, parse, NULL, NULL, NULL, napi_default, NULL},
+		{"parseFile", NULL, parseFile, NULL, NULL, NULL, napi_default, NULL},
+		{"encode", NULL, encode, NULL, NULL, NULL, napi_default, NULL},
+		{"encodeInto", NULL, encodeInto, NULL, NULL, NULL, napi_default, NULL},
+		{"decode", NULL, decode, NULL, NULL, NULL, napi_default, NULL},
+		{"decodePacked", NULL, decodePacked, NULL, NULL, NULL, napi_default, NULL},
+		{"encodeBatch", NULL, encodeBatch, NULL, NULL, NULL, napi_default, NULL},
+		{"decodeBatch", NULL, decodeBatch, NULL, NULL, NULL, napi_default, NULL},
+		{"setOption", NULL, setOption, NULL, NULL, NULL, napi_default, NULL},
+		{"destroy", NULL, destroy, NULL, NULL, NULL, napi_default, NULL},
+		{"debug", NULL, debug, NULL, NULL, NULL, napi_default, NULL},
+		{"pack", NULL, pack, NULL, NULL, NULL, napi_default, NULL},
+		{"unpack", NULL, unpack, NULL, NULL, NULL, napi_default, NULL},
+		{"compress", NULL, compress, NULL, NULL, NULL, napi_default, NULL},
+		{"decompress", NULL, decompress, NULL, NULL, NULL, napi_default, NULL},
+		{"packAsync", NULL, packAsync, NULL, NULL, NULL, napi_default, NULL},
+		{"unpackAsync", NULL, unpackAsync, NULL, NULL, NULL, napi_default, NULL},
+		{"verifyAsync", NULL, verifyAsync, NULL, NULL, NULL, napi_default, NULL},
+	};
+
+	napi_define_properties(env, exports, sizeof(methods) / sizeof(methods[0]), methods);
+	setConstant(env, exports, "OPT_INTEGRITY", SGE_OPT_INTEGRITY);
+	setConstant(env, exports, "OPT_VERSION", SGE_OPT_VERSION);
+	setConstant(env, exports, "OPT_ASYNC_THRESHOLD", OPT_ASYNC_THRESHOLD);
+	setConstant(env, exports, "INTEGRITY_CRC16", SGE_INTEGRITY_CRC16);
+	setConstant(env, exports, "INTEGRITY_NONE", SGE_INTEGRITY_NONE);
+	setConstant(env, exports, "INTEGRITY_CRC32C", SGE_INTEGRITY_CRC32C);
+	setConstant(env, exports, "VERSION_1", SGE_VERSION_1);
+	setConstant(env, exports, "VERSION_2", SGE_VERSION_2);
+	setConstant(env, exports, "VERSION_3", SGE_VERSION_3);
+	setConstant(env, exports, "OPT_PRESENCE", SGE_OPT_PRESENCE);
+	setConstant(env, exports, "OPT_DEFAULTS", SGE_OPT_DEFAULTS);
+	setConstant(env, exports, "PRESENCE_NONE", SGE_PRESENCE_NONE);
+	setConstant(env, exports, "PRESENCE_BITMAP", SGE_PRESENCE_BITMAP);
+	setConstant(env, exports, "DEFAULTS_FILL", SGE_DEFAULTS_FILL);
+	setConstant(env, exports, "DEFAULTS_SKIP", SGE_DEFAULTS_SKIP);
+	return exports;
 }
 
-NODE_MODULE(NODE_GYP_MODULE_NAME, Initialize)
+NAPI_MODULE(NODE_GYP_MODULE_NAME, Init)
 
 } // namespace sgeProto
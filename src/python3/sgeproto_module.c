@@ -1,22 +1,255 @@
 #include <Python.h>
+#include <structmember.h>
 
 #include "../core/sge_proto.h"
+#include "../core/sge_pack.h"
 
 #define BUFFER_SIZE	2048
 
+// what every field keeps in its slot, made once per schema
+typedef struct py_field {
+	PyObject *key;			// interned field name
+	PyTypeObject *owner;	// generated class of the block holding the field
+	Py_ssize_t offset;		// of the field's member in an owner instance
+	PyTypeObject *type;		// generated class of a custom field's block
+} py_field;
+
+// block name -> generated __slots__ class
+static PyObject *g_classes = NULL;
+
+// the fields decode was last given and their projection, compiled again when they change or the schema does
+static PyObject *g_projection_fields = NULL;
+static sge_projection *g_projection = NULL;
+
+static void
+py_clear_projection(void) {
+	Py_CLEAR(g_projection_fields);
+	sge_projection_free(g_projection);
+	g_projection = NULL;
+}
+
+static sge_projection *
+py_projection(PyObject *fields) {
+	PyObject *list;
+	const char **paths;
+	Py_ssize_t i, count;
+
+	list = PySequence_List(fields);
+	if (NULL == list) {
+		return NULL;
+	}
+	if (g_projection && 1 == PyObject_RichCompareBool(list, g_projection_fields, Py_EQ)) {
+		Py_DECREF(list);
+		return g_projection;
+	}
+
+	count = PyList_GET_SIZE(list);
+	paths = PyMem_Malloc(sizeof(char *) * (count ? count : 1));
+	if (NULL == paths) {
+		Py_DECREF(list);
+		PyErr_NoMemory();
+		return NULL;
+	}
+	for (i = 0; i < count; ++i) {
+		paths[i] = PyUnicode_Check(PyList_GET_ITEM(list, i)) ? PyUnicode_AsUTF8(PyList_GET_ITEM(list, i)) : NULL;
+		if (NULL == paths[i]) {
+			PyMem_Free(paths);
+			Py_DECREF(list);
+			PyErr_Format(PyExc_TypeError, "fields must be str paths like 'Block.field'");
+			return NULL;
+		}
+	}
+
+	py_clear_projection();
+	g_projection = sge_projection_new(paths, count);
+	PyMem_Free(paths);
+	if (NULL == g_projection) {
+		Py_DECREF(list);
+		PyErr_Format(PyExc_ValueError, "%s", sge_error(SGE_ERR));
+		return NULL;
+	}
+	g_projection_fields = list;
+	return g_projection;
+}
+
+static void *
+py_bind_field(void *slot, const char *name, size_t name_len, void *ud) {
+	py_field *field;
+
+	if (slot) {
+		return slot;
+	}
+	field = PyMem_Calloc(1, sizeof(py_field));
+	if (NULL == field) {
+		return NULL;
+	}
+	field->key = PyUnicode_FromStringAndSize(name, name_len);
+	if (NULL == field->key) {
+		PyErr_Clear();
+		PyMem_Free(field);
+		return NULL;
+	}
+	PyUnicode_InternInPlace(&field->key);
+	return field;
+}
+
+static void *
+py_release_field(void *slot, const char *name, size_t name_len, void *ud) {
+	py_field *field = (py_field *)slot;
+
+	if (field) {
+		Py_DECREF(field->key);
+		PyMem_Free(field);
+	}
+	return NULL;
+}
+
+// a new reference to the key of the field
+static PyObject *
+py_field_key(const sge_value *ud) {
+	py_field *field = (py_field *)ud->slot;
+
+	if (field) {
+		Py_INCREF(field->key);
+		return field->key;
+	}
+	return PyUnicode_FromString(ud->name);
+}
+
+// a slot named __x is stored mangled as _Class__x
+static Py_ssize_t
+py_member_offset(PyTypeObject *type, const char *name) {
+	PyMemberDef *member;
+	const char *cls = type->tp_name;
+	size_t len;
+
+	while (*cls == '_') {
+		++cls;
+	}
+	len = strlen(cls);
+	for (member = type->tp_members; member && member->name; ++member) {
+		if (0 == strcmp(member->name, name)) {
+			return member->offset;
+		}
+		if (0 == strncmp(name, "__", 2) && member->name[0] == '_' &&
+			0 == strncmp(member->name + 1, cls, len) && 0 == strcmp(member->name + 1 + len, name)) {
+			return member->offset;
+		}
+	}
+	return -1;
+}
+
+static PyObject *
+py_make_class(sge_block_handle block) {
+	uint32_t i;
+	sge_value field;
+	PyObject *slots, *cls = NULL;
+
+	slots = PyList_New(0);
+	if (NULL == slots) {
+		return NULL;
+	}
+	for (i = 0; SGE_OK == sge_block_field(block, i, &field); ++i) {
+		if (NULL == field.slot || 0 != PyList_Append(slots, ((py_field *)field.slot)->key)) {
+			goto RET;
+		}
+	}
+	cls = PyObject_CallFunction((PyObject *)&PyType_Type, "s(O){s:O,s:s}",
+		sge_block_name(block), &PyBaseObject_Type, "__slots__", slots, "__module__", "sgeProto");
+	// names like __dict__ don't make members, such a block gets no class
+	for (i = 0; cls && SGE_OK == sge_block_field(block, i, &field); ++i) {
+		if (py_member_offset((PyTypeObject *)cls, field.name) < 0) {
+			Py_DECREF(cls);
+			Py_INCREF(Py_None);
+			cls = Py_None;
+		}
+	}
+	RET:
+	Py_DECREF(slots);
+	return cls;
+}
+
+// a class per block, then every field learns where it lives; classes made by an earlier parse stay until the schema is
+// cleared
+static int
+py_build_classes(void) {
+	uint32_t i;
+	sge_value field;
+	sge_block_handle block;
+	PyObject *cls;
+	py_field *f;
+	const char *name;
+
+	if (NULL == g_classes && NULL == (g_classes = PyDict_New())) {
+		return SGE_ERR;
+	}
+	for (block = sge_block_next(NULL); block; block = sge_block_next(block)) {
+		name = sge_block_name(block);
+		// a later block with a taken name is never looked up
+		if (block != sge_block_find(name) || PyDict_GetItemString(g_classes, name)) {
+			continue;
+		}
+		cls = py_make_class(block);
+		if (cls == Py_None) {
+			Py_DECREF(cls);
+			continue;
+		}
+		if (NULL == cls || 0 != PyDict_SetItemString(g_classes, name, cls)) {
+			Py_XDECREF(cls);
+			return SGE_ERR;
+		}
+		Py_DECREF(cls);
+	}
+
+	for (block = sge_block_next(NULL); block; block = sge_block_next(block)) {
+		name = sge_block_name(block);
+		if (block != sge_block_find(name)) {
+			continue;
+		}
+		cls = PyDict_GetItemString(g_classes, name);
+		if (NULL == cls) {
+			continue;
+		}
+		for (i = 0; SGE_OK == sge_block_field(block, i, &field); ++i) {
+			f = (py_field *)field.slot;
+			if (NULL == f) {
+				PyErr_NoMemory();
+				return SGE_ERR;
+			}
+			f->owner = (PyTypeObject *)cls;
+			f->offset = py_member_offset(f->owner, field.name);
+			if (f->offset < 0) {
+				f->owner = NULL;
+				PyErr_Format(PyExc_RuntimeError, "class %s has no member %s", name, field.name);
+				return SGE_ERR;
+			}
+			if (field.ptr) {
+				f->type = (PyTypeObject *)PyDict_GetItemString(g_classes, sge_block_name(field.ptr));
+			}
+		}
+	}
+	return SGE_OK;
+}
+
+static int
+py_is_generated(PyObject *object) {
+	return g_classes && (PyObject *)Py_TYPE(object) == PyDict_GetItemString(g_classes, Py_TYPE(object)->tp_name);
+}
+
 static void
 py_field_get(const void *pyObject, sge_value* ud) {
-	const char *field_name = ud->name;
 	PyObject *key = NULL;
 	PyObject *value = NULL;
 	PyObject *object = (PyObject *)pyObject;
-
-	key = PyUnicode_FromString(field_name);
+	py_field *field = (py_field *)ud->slot;
 
 	if (PyDict_Check(object)) {
+		key = py_field_key(ud);
 		value = PyDict_GetItem(object, key);
 	} else if (PyList_Check(object)) {
 		value = PyList_GetItem(object, ud->idx);
+	} else if (field && Py_TYPE(object) == field->owner) {
+		value = *(PyObject **)((char *)object + field->offset);
 	}
 
 	if (NULL == value) {
@@ -35,6 +268,9 @@ py_field_get(const void *pyObject, sge_value* ud) {
 	} else if (PyDict_Check(value)) {
 		ud->ptr = (void *)value;
 		ud->len = PyDict_Size(value);
+	} else if (field && Py_TYPE(value) == field->type) {
+		ud->ptr = (void *)value;
+		ud->len = 1;
 	}
 RET:
 	Py_XDECREF(key);
@@ -63,7 +299,7 @@ py_field_set(void *pyObject, sge_value *ud) {
 	}
 
 	if (ud->idx == -1) {
-		key = PyUnicode_FromString(ud->name);
+		key = py_field_key(ud);
 		PyDict_SetItem(object, key, value);
 	}
 	else {
@@ -76,6 +312,49 @@ py_field_set(void *pyObject, sge_value *ud) {
 	return value;
 }
 
+// decode into generated classes, members are stored straight at their offset
+static void *
+py_object_set(void *pyObject, sge_value *ud) {
+	PyObject *object = (PyObject *)pyObject;
+	PyObject *key, *value = NULL, *old;
+	PyObject **member;
+	py_field *field = (py_field *)ud->slot;
+
+	switch (ud->vt) {
+		case SGE_NUMBER:
+			value = PyLong_FromLong(*((long *)ud->ptr));
+			break;
+		case SGE_STRING:
+			value = PyUnicode_FromStringAndSize(ud->ptr, ud->len);
+			break;
+		case SGE_DICT:
+			value = (field && field->type) ? field->type->tp_alloc(field->type, 0) : PyDict_New();
+			break;
+		case SGE_LIST:
+			value = PyList_New(ud->len);
+			break;
+	}
+	if (NULL == value) {
+		return NULL;
+	}
+
+	if (ud->idx != -1) {
+		PyList_SetItem(object, ud->idx, value);
+	} else if (field && Py_TYPE(object) == field->owner) {
+		member = (PyObject **)((char *)object + field->offset);
+		old = *member;
+		*member = value;
+		Py_XDECREF(old);
+	} else {
+		// a block without a class decodes to a dict
+		key = py_field_key(ud);
+		PyDict_SetItem(object, key, value);
+		Py_XDECREF(key);
+		Py_DECREF(value);
+	}
+	return value;
+}
+
 PyObject *
 py_sge_parse(PyObject *self, PyObject *buffer) {
 	const char *buf = NULL;
@@ -87,13 +366,22 @@ py_sge_parse(PyObject *self, PyObject *buffer) {
 	}
 
 	buf = PyUnicode_AsUTF8(buffer);
+	py_clear_projection();
+	// a failed parse clears the whole schema without visiting its fields, so every slot is released before and bound
+	// again after
+	sge_bind_fields(py_release_field, NULL);
 	ret = sge_parse((char*)buf);
+	sge_bind_fields(py_bind_field, NULL);
 	if (ret == SGE_OK) {
+		if (SGE_OK != py_build_classes()) {
+			return NULL;
+		}
 		Py_RETURN_TRUE;
 	} else {
-		const char* err = sge_error(ret);
-		PyErr_Format(PyExc_RuntimeError, err);
-		Py_RETURN_FALSE;
+		// the failed parse cleared the schema, the classes of its blocks go with it
+		Py_CLEAR(g_classes);
+		PyErr_SetString(PyExc_RuntimeError, sge_error(ret));
+		return NULL;
 	}
 }
 
@@ -107,14 +395,20 @@ py_sge_parse_file(PyObject *self, PyObject *file) {
 		Py_RETURN_FALSE;
 	}
 	filename = PyUnicode_AsUTF8(file);
+	py_clear_projection();
+	sge_bind_fields(py_release_field, NULL);
 	ret = sge_parse_file(filename);
+	sge_bind_fields(py_bind_field, NULL);
 	if (ret == SGE_OK) {
+		if (SGE_OK != py_build_classes()) {
+			return NULL;
+		}
 		Py_RETURN_TRUE;
 	}
 
-	const char* err = sge_error(ret);
-	PyErr_Format(PyExc_RuntimeError, err);
-	Py_RETURN_FALSE;
+	Py_CLEAR(g_classes);
+	PyErr_SetString(PyExc_RuntimeError, sge_error(ret));
+	return NULL;
 }
 
 PyObject *
@@ -135,59 +429,222 @@ py_sge_encode(PyObject *self, PyObject *args) {
 		PyErr_Format(PyExc_TypeError, "args 1 must be str");
 		Py_RETURN_FALSE;
 	}
-	if (!PyDict_Check(userdata)) {
-		PyErr_Format(PyExc_TypeError, "args 2 must be dict");
+	if (!PyDict_Check(userdata) && !py_is_generated(userdata)) {
+		PyErr_Format(PyExc_TypeError, "args 2 must be dict or a generated class");
 		Py_RETURN_FALSE;
 	}
 
-	memset(buffer, 0, BUFFER_SIZE);
 	name = PyUnicode_AsUTF8(proto_name);
-	size = sge_encode(name, userdata, buffer, py_field_get);
+	size = sge_encode_n(name, userdata, buffer, BUFFER_SIZE, py_field_get);
 	if (size <= 0) {
 		const char* err = sge_error(size);
 		PyErr_Format(PyExc_RuntimeError, err);
 		goto ERR;
 	}
-	buf_obj = PyBytes_FromStringAndSize(buffer, size);
+	if (size <= BUFFER_SIZE) {
+		buf_obj = PyBytes_FromStringAndSize(buffer, size);
+		goto ERR;
+	}
+
+	// too big for the stack buffer, encode again straight into a bytes of the reported size
+	buf_obj = PyBytes_FromStringAndSize(NULL, size);
+	if (NULL == buf_obj) {
+		goto ERR;
+	}
+	if (size != sge_encode_n(name, userdata, PyBytes_AS_STRING(buf_obj), size, py_field_get)) {
+		Py_CLEAR(buf_obj);
+		PyErr_Format(PyExc_RuntimeError, "message changed while encoding");
+	}
 	ERR:
 	return buf_obj;
 }
 
+// encode straight into a writable buffer at offset, returns the bytes written
 PyObject *
-py_sge_decode(PyObject *self, PyObject *buf_obj) {
-	PyObject *object, *proto_obj, *ret;
+py_sge_encode_into(PyObject *self, PyObject *args) {
+	int size;
+	const char *name;
+	PyObject *userdata, *ret = NULL;
+	Py_ssize_t offset = 0;
+	Py_buffer view;
+
+	if (!PyArg_ParseTuple(args, "sOw*|n", &name, &userdata, &view, &offset)) {
+		return NULL;
+	}
+	if (!PyDict_Check(userdata) && !py_is_generated(userdata)) {
+		PyErr_Format(PyExc_TypeError, "args 2 must be dict or a generated class");
+		goto RET;
+	}
+	if (offset < 0 || offset > view.len) {
+		PyErr_Format(PyExc_ValueError, "offset %zd out of a %zd byte buffer", offset, view.len);
+		goto RET;
+	}
+
+	size = sge_encode_n(name, userdata, (char *)view.buf + offset, view.len - offset, py_field_get);
+	if (size <= 0) {
+		PyErr_Format(PyExc_RuntimeError, sge_error(size));
+		goto RET;
+	}
+	if (size > view.len - offset) {
+		PyErr_Format(PyExc_BufferError, "%s needs %d bytes, %zd left", name, size, view.len - offset);
+		goto RET;
+	}
+	ret = PyLong_FromLong(size);
+
+	RET:
+	PyBuffer_Release(&view);
+	return ret;
+}
+
+// decode, decodePacked, decodeObject, pack and unpack read any buffer-protocol object: (buffer, offset=0, length=-1)
+static int
+py_slice_view(Py_buffer *view, Py_ssize_t offset, Py_ssize_t length, const char **data, Py_ssize_t *len) {
+	if (length < 0 && offset >= 0) {
+		length = view->len - offset;
+	}
+	if (offset < 0 || offset > view->len || length < 0 || length > view->len - offset) {
+		PyErr_Format(PyExc_ValueError, "offset %zd and length %zd out of a %zd byte buffer", offset, length, view->len);
+		return SGE_ERR;
+	}
+	*data = (const char *)view->buf + offset;
+	*len = length;
+	return SGE_OK;
+}
+
+// a frame, or with packed the output of pack, decoded as it is unpacked; fields=[paths] decodes only those
+static PyObject *
+py_decode_call(PyObject *args, PyObject *kwargs, int packed) {
+	static char *kwlist[] = {"buffer", "offset", "length", "fields", NULL};
+	PyObject *object, *fields = Py_None, *ret = NULL;
+	sge_projection *proj = NULL;
 	int proto_idx;
-	char *buffer = NULL;
+	const char *buffer = NULL;
+	Py_ssize_t offset = 0, length = -1;
+	Py_buffer view;
 
-	if (!PyBytes_Check(buf_obj)) {
-		PyErr_Format(PyExc_TypeError, "args 1 must be bytes.");
-		Py_RETURN_FALSE;
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*|nnO", kwlist, &view, &offset, &length, &fields)) {
+		return NULL;
+	}
+	if (packed && fields != Py_None) {
+		PyErr_Format(PyExc_TypeError, "decodePacked doesn't take fields");
+		goto RET;
+	}
+	if (SGE_OK != py_slice_view(&view, offset, length, &buffer, &length)) {
+		goto RET;
+	}
+	if (packed ? length < 1 : length < 6) {
+		PyErr_Format(PyExc_RuntimeError, "bytes wrong format.");
+		goto RET;
+	}
+	if (fields != Py_None && NULL == (proj = py_projection(fields))) {
+		goto RET;
 	}
 
-	buffer = PyBytes_AsString(buf_obj);
 	object = PyDict_New();
 	if (object == NULL) {
-		Py_RETURN_FALSE;
+		goto RET;
 	}
 
-	proto_idx = sge_decode(buffer, object, py_field_set);
+	if (packed) {
+		proto_idx = sge_decode_packed(buffer, length, object, py_field_set);
+	} else if (proj) {
+		proto_idx = sge_decode_projected(buffer, length, proj, object, py_field_set);
+	} else {
+		proto_idx = sge_decode_n(buffer, length, object, py_field_set);
+	}
 	if (proto_idx < 0) {
 		Py_DECREF(object);
-		const char* err = sge_error(proto_idx);
-		PyErr_Format(PyExc_RuntimeError, err);
-		Py_RETURN_FALSE;
+		PyErr_Format(PyExc_RuntimeError, sge_error(proto_idx));
+		goto RET;
+	}
+	ret = Py_BuildValue("(iN)", proto_idx, object);
+
+	RET:
+	PyBuffer_Release(&view);
+	return ret;
+}
+
+PyObject *
+py_sge_decode(PyObject *self, PyObject *args, PyObject *kwargs) {
+	return py_decode_call(args, kwargs, 0);
+}
+
+PyObject *
+py_sge_decode_packed(PyObject *self, PyObject *args, PyObject *kwargs) {
+	return py_decode_call(args, kwargs, 1);
+}
+
+PyObject *
+py_sge_decode_object(PyObject *self, PyObject *args) {
+	PyObject *object, *ret = NULL;
+	PyTypeObject *cls;
+	sge_block_handle block;
+	int proto_idx;
+	const char *buffer = NULL;
+	Py_ssize_t offset = 0, length = -1;
+	Py_buffer view;
+
+	if (!PyArg_ParseTuple(args, "y*|nn", &view, &offset, &length)) {
+		return NULL;
+	}
+	if (SGE_OK != py_slice_view(&view, offset, length, &buffer, &length)) {
+		goto RET;
 	}
 
-	proto_obj = PyLong_FromLong(proto_idx);
-	ret = PyTuple_New(2);
-	PyTuple_SetItem(ret, 0, proto_obj);
-	PyTuple_SetItem(ret, 1, object);
+	block = length < 6 ? NULL : sge_frame_block(buffer);
+	if (NULL == block) {
+		PyErr_Format(PyExc_RuntimeError, length < 6 ? "bytes wrong format." : sge_error(SGE_ERR));
+		goto RET;
+	}
+	cls = g_classes ? (PyTypeObject *)PyDict_GetItemString(g_classes, sge_block_name(block)) : NULL;
+	if (NULL == cls) {
+		PyErr_Format(PyExc_RuntimeError, "protocol %s has no generated class", sge_block_name(block));
+		goto RET;
+	}
 
+	object = cls->tp_alloc(cls, 0);
+	if (NULL == object) {
+		goto RET;
+	}
+	proto_idx = sge_decode_n(buffer, length, object, py_object_set);
+	if (proto_idx < 0) {
+		Py_DECREF(object);
+		PyErr_Format(PyExc_RuntimeError, sge_error(proto_idx));
+		goto RET;
+	}
+	ret = Py_BuildValue("(iN)", proto_idx, object);
+
+	RET:
+	PyBuffer_Release(&view);
 	return ret;
 }
 
+PyObject *
+py_sge_classes(PyObject *self, PyObject *args) {
+	return g_classes ? PyDict_Copy(g_classes) : PyDict_New();
+}
+
+PyObject *
+py_sge_set_option(PyObject *self, PyObject *args) {
+	int option, value, ret;
+
+	if (!PyArg_ParseTuple(args, "ii", &option, &value)) {
+		return NULL;
+	}
+
+	ret = sge_set_option(option, value);
+	if (ret != SGE_OK) {
+		PyErr_Format(PyExc_ValueError, "invalid option %d or value %d", option, value);
+		return NULL;
+	}
+	Py_RETURN_NONE;
+}
+
 PyObject *
 py_sge_destroy(PyObject *self, PyObject *args) {
+	sge_bind_fields(py_release_field, NULL);
+	Py_CLEAR(g_classes);
+	py_clear_projection();
 	sge_destroy(1);
 	Py_RETURN_NONE;
 }
@@ -198,69 +655,503 @@ py_sge_debug(PyObject *self, PyObject *args) {
 	Py_RETURN_NONE;
 }
 
-PyObject*
-py_sge_pack(PyObject *self, PyObject *args) {
-	PyObject* out_byte = NULL;
-	char* buf = NULL;
-	char outbuf[BUFFER_SIZE];
+// sge_pack and sge_unpack write at most len + len / 8 + 1 and len * 8 bytes; unpack gives back whole groups, so a
+// frame that ends in zero bytes comes back with them and decodes
+static PyObject *
+py_pack_call(PyObject *args, int pack) {
+	PyObject *out_byte = NULL;
+	const char *buf = NULL;
+	char stack[BUFFER_SIZE];
+	char *out = stack;
 	int outlen = 0;
-	Py_ssize_t buflen = 0;
+	size_t bound, groups = SIZE_MAX;
+	Py_ssize_t offset = 0, length = -1;
+	Py_buffer view;
 
-	if (!PyBytes_Check(args)) {
-		PyErr_Format(PyExc_TypeError, "args 1 must be bytes.");
-		Py_RETURN_FALSE;
+	if (!PyArg_ParseTuple(args, "y*|nn", &view, &offset, &length)) {
+		return NULL;
+	}
+	if (SGE_OK != py_slice_view(&view, offset, length, &buf, &length)) {
+		goto RET;
+	}
+	if (length > INT_MAX / 8) {
+		PyErr_Format(PyExc_ValueError, "%zd bytes is too long", length);
+		goto RET;
+	}
+
+	bound = pack ? (size_t)length + length / 8 + 1 : (size_t)length * 8;
+	if (bound > BUFFER_SIZE) {
+		out = PyMem_Malloc(bound);
+		if (NULL == out) {
+			PyErr_NoMemory();
+			goto RET;
+		}
 	}
 
-	memset(outbuf, 0, BUFFER_SIZE);
-	PyBytes_AsStringAndSize(args, &buf, &buflen);
-	outlen = sge_pack((const char*)buf, buflen, outbuf);
+	if (pack || length <= 0) {
+		outlen = pack ? sge_pack(buf, length, out) : sge_unpack(buf, length, out);
+	} else {
+		outlen = sge_unpack_groups(buf, buf + length, out, &groups) ? (int)(groups * 8) : INVALID_PARAM;
+	}
 	if (outlen < 0) {
-		const char* err = sge_error(outlen);
-		PyErr_Format(PyExc_RuntimeError, err);
-		goto ERROR;
+		PyErr_Format(PyExc_RuntimeError, sge_error(outlen));
+		goto RET;
 	}
+	out_byte = PyBytes_FromStringAndSize(out, outlen);
 
-	out_byte = PyBytes_FromStringAndSize((const char*)outbuf, outlen);
-	ERROR:
+	RET:
+	if (out != stack) {
+		PyMem_Free(out);
+	}
+	PyBuffer_Release(&view);
 	return out_byte;
 }
 
+PyObject*
+py_sge_pack(PyObject *self, PyObject *args) {
+	return py_pack_call(args, 1);
+}
+
 PyObject*
 py_sge_unpack(PyObject *self, PyObject *args) {
-	PyObject* out_byte = NULL;
-	char* buf = NULL;
-	char outbuf[BUFFER_SIZE];
+	return py_pack_call(args, 0);
+}
+
+PyObject*
+py_sge_compress(PyObject *self, PyObject *args) {
+	PyObject *out_byte = NULL;
+	const char *buf = NULL;
+	char stack[BUFFER_SIZE];
+	char *out = stack;
 	int outlen = 0;
-	Py_ssize_t buflen = 0;
+	size_t bound;
+	Py_ssize_t offset = 0, length = -1;
+	Py_buffer view;
 
-	if (!PyBytes_Check(args)) {
-		PyErr_Format(PyExc_TypeError, "args 1 must be bytes.");
-		Py_RETURN_FALSE;
+	if (!PyArg_ParseTuple(args, "y*|nn", &view, &offset, &length)) {
+		return NULL;
+	}
+	if (SGE_OK != py_slice_view(&view, offset, length, &buf, &length)) {
+		goto RET;
+	}
+	if (length > INT_MAX / 2) {
+		PyErr_Format(PyExc_ValueError, "%zd bytes is too long", length);
+		goto RET;
+	}
+
+	bound = SGE_COMPRESS_BOUND((size_t)length);
+	if (bound > BUFFER_SIZE) {
+		out = PyMem_Malloc(bound);
+		if (NULL == out) {
+			PyErr_NoMemory();
+			goto RET;
+		}
 	}
 
-	memset(outbuf, 0, BUFFER_SIZE);
-	PyBytes_AsStringAndSize(args, &buf, &buflen);
-	outlen = sge_unpack((const char*)buf, buflen, outbuf);
+	outlen = sge_compress(buf, length, out);
 	if (outlen < 0) {
-		const char* err = sge_error(outlen);
-		PyErr_Format(PyExc_RuntimeError, err);
-		goto ERROR;
+		PyErr_Format(PyExc_RuntimeError, sge_error(outlen));
+		goto RET;
+	}
+	out_byte = PyBytes_FromStringAndSize(out, outlen);
+
+	RET:
+	if (out != stack) {
+		PyMem_Free(out);
+	}
+	PyBuffer_Release(&view);
+	return out_byte;
+}
+
+// the header of a compressed frame tells its size, so the result is decompressed in place
+PyObject*
+py_sge_decompress(PyObject *self, PyObject *args) {
+	PyObject *out_byte = NULL;
+	const char *buf = NULL;
+	int size;
+	Py_ssize_t offset = 0, length = -1;
+	Py_buffer view;
+
+	if (!PyArg_ParseTuple(args, "y*|nn", &view, &offset, &length)) {
+		return NULL;
+	}
+	if (SGE_OK != py_slice_view(&view, offset, length, &buf, &length)) {
+		goto RET;
+	}
+
+	size = sge_decompress(buf, length, NULL, 0);
+	if (size < 0) {
+		PyErr_Format(PyExc_RuntimeError, sge_error(size));
+		goto RET;
+	}
+	out_byte = PyBytes_FromStringAndSize(NULL, size);
+	if (NULL == out_byte) {
+		goto RET;
+	}
+	size = sge_decompress(buf, length, PyBytes_AS_STRING(out_byte), size);
+	if (size < 0) {
+		PyErr_Format(PyExc_RuntimeError, sge_error(size));
+		Py_CLEAR(out_byte);
 	}
 
-	out_byte = PyBytes_FromStringAndSize((const char*)outbuf, outlen);
-	ERROR:
+	RET:
+	PyBuffer_Release(&view);
 	return out_byte;
 }
 
+PyObject *
+py_sge_encode_batch(PyObject *self, PyObject *args) {
+	int size = 0, pack = 0;
+	Py_ssize_t i, count;
+	char buffer[BUFFER_SIZE];
+	char *frame = buffer, *packed = NULL;
+	PyObject *list, *item;
+	PyObject *buf_obj = NULL;
+	sge_batch_item *items = NULL;
+
+	if (!PyArg_ParseTuple(args, "O!|p", &PyList_Type, &list, &pack)) {
+		return NULL;
+	}
+
+	count = PyList_GET_SIZE(list);
+	items = PyMem_Malloc(sizeof(sge_batch_item) * (count ? count : 1));
+	if (NULL == items) {
+		return PyErr_NoMemory();
+	}
+	for (i = 0; i < count; ++i) {
+		item = PyList_GET_ITEM(list, i);
+		if (!PyTuple_Check(item) || PyTuple_GET_SIZE(item) != 2 ||
+			!PyUnicode_Check(PyTuple_GET_ITEM(item, 0)) ||
+			(!PyDict_Check(PyTuple_GET_ITEM(item, 1)) && !py_is_generated(PyTuple_GET_ITEM(item, 1)))) {
+			PyErr_Format(PyExc_TypeError, "item %zd must be a (str, dict or generated class) tuple", i);
+			goto ERR;
+		}
+		items[i].name = PyUnicode_AsUTF8(PyTuple_GET_ITEM(item, 0));
+		items[i].ud = PyTuple_GET_ITEM(item, 1);
+	}
+
+	size = sge_encode_batch(items, count, buffer, BUFFER_SIZE, py_field_get);
+	if (size > BUFFER_SIZE) {
+		frame = PyMem_Malloc(size);
+		if (NULL == frame) {
+			PyErr_NoMemory();
+			goto ERR;
+		}
+		if (size != sge_encode_batch(items, count, frame, size, py_field_get)) {
+			size = SGE_ERR;
+		}
+	}
+	if (size <= 0) {
+		PyErr_Format(PyExc_RuntimeError, sge_error(size));
+		goto ERR;
+	}
+
+	if (pack) {
+		// one mask byte per 8 input bytes
+		packed = PyMem_Malloc(size + size / 8 + 2);
+		if (NULL == packed) {
+			PyErr_NoMemory();
+			goto ERR;
+		}
+		buf_obj = PyBytes_FromStringAndSize(packed, sge_pack(frame, size, packed));
+	} else {
+		buf_obj = PyBytes_FromStringAndSize(frame, size);
+	}
+
+	ERR:
+	PyMem_Free(packed);
+	if (frame != buffer) {
+		PyMem_Free(frame);
+	}
+	PyMem_Free(items);
+	return buf_obj;
+}
+
+PyObject *
+py_sge_decode_batch(PyObject *self, PyObject *args) {
+	int ret, unpack = 0;
+	uint32_t proto_idx;
+	Py_ssize_t i, count, len;
+	const char *buffer = NULL;
+	char *unpacked = NULL;
+	PyObject *object, *item;
+	PyObject *list = NULL;
+	Py_buffer view;
+	sge_batch_iter it;
+
+	if (!PyArg_ParseTuple(args, "y*|p", &view, &unpack)) {
+		return NULL;
+	}
+
+	buffer = view.buf;
+	len = view.len;
+	if (unpack && len > INT_MAX / 8) {
+		PyErr_Format(PyExc_ValueError, "batch is too long");
+		goto ERR;
+	}
+	if (unpack && len) {
+		// sge_unpack drops trailing zero bytes, decode from the zero filled upper bound
+		unpacked = PyMem_Calloc(len, 8);
+		if (NULL == unpacked) {
+			PyErr_NoMemory();
+			goto ERR;
+		}
+		sge_unpack(buffer, len, unpacked);
+		buffer = unpacked;
+		len *= 8;
+	}
+
+	count = sge_decode_batch(buffer, len, &it);
+	if (count < 0) {
+		PyErr_Format(PyExc_RuntimeError, sge_error(count));
+		goto ERR;
+	}
+
+	list = PyList_New(count);
+	if (NULL == list) {
+		goto ERR;
+	}
+	for (i = 0; i < count; ++i) {
+		object = PyDict_New();
+		if (NULL == object) {
+			Py_CLEAR(list);
+			goto ERR;
+		}
+		ret = sge_batch_next(&it, object, py_field_set, &proto_idx);
+		if (ret != 1) {
+			Py_DECREF(object);
+			Py_CLEAR(list);
+			PyErr_Format(PyExc_RuntimeError, sge_error(ret < 0 ? ret : SGE_ERR));
+			goto ERR;
+		}
+		item = Py_BuildValue("(IN)", proto_idx, object);
+		if (NULL == item) {
+			Py_CLEAR(list);
+			goto ERR;
+		}
+		PyList_SET_ITEM(list, i, item);
+	}
+
+	ERR:
+	PyMem_Free(unpacked);
+	PyBuffer_Release(&view);
+	return list;
+}
+
+// every object of the iterable to its own frame; with pack, the frames are packed with the GIL released
+PyObject *
+py_sge_encode_many(PyObject *self, PyObject *args) {
+	int size, pack = 0;
+	const char *name;
+	char *frames = NULL, *packed = NULL, *grown;
+	size_t used = 0, capacity = BUFFER_SIZE, bound = 0;
+	Py_ssize_t i, count;
+	PyObject *iterable, *seq, *object, *item;
+	PyObject *list = NULL;
+	size_t *offsets = NULL;
+	int *sizes = NULL;
+
+	if (!PyArg_ParseTuple(args, "sO|p", &name, &iterable, &pack)) {
+		return NULL;
+	}
+	seq = PySequence_Fast(iterable, "args 2 must be iterable");
+	if (NULL == seq) {
+		return NULL;
+	}
+
+	count = PySequence_Fast_GET_SIZE(seq);
+	offsets = PyMem_Malloc(sizeof(size_t) * (count ? count : 1));
+	sizes = PyMem_Malloc(sizeof(int) * (count ? count : 1));
+	frames = PyMem_Malloc(capacity);
+	if (NULL == offsets || NULL == sizes || NULL == frames) {
+		PyErr_NoMemory();
+		goto RET;
+	}
+
+	for (i = 0; i < count; ++i) {
+		object = PySequence_Fast_GET_ITEM(seq, i);
+		if (!PyDict_Check(object) && !py_is_generated(object)) {
+			PyErr_Format(PyExc_TypeError, "item %zd must be dict or a generated class", i);
+			goto RET;
+		}
+		size = sge_encode_n(name, object, frames + used, capacity - used, py_field_get);
+		if (size > 0 && (size_t)size > capacity - used) {
+			capacity = (capacity * 2 > used + size) ? capacity * 2 : used + size;
+			grown = PyMem_Realloc(frames, capacity);
+			if (NULL == grown) {
+				PyErr_NoMemory();
+				goto RET;
+			}
+			frames = grown;
+			size = sge_encode_n(name, object, frames + used, capacity - used, py_field_get);
+		}
+		if (size <= 0 || (size_t)size > capacity - used) {
+			PyErr_Format(PyExc_RuntimeError, size <= 0 ? sge_error(size) : "message changed while encoding");
+			goto RET;
+		}
+		offsets[i] = used;
+		sizes[i] = size;
+		used += size;
+		bound += size + size / 8 + 1;
+	}
+
+	if (pack && count) {
+		packed = PyMem_Malloc(bound);
+		if (NULL == packed) {
+			PyErr_NoMemory();
+			goto RET;
+		}
+		Py_BEGIN_ALLOW_THREADS
+		for (i = 0, bound = 0; i < count; ++i) {
+			size = sge_pack(frames + offsets[i], sizes[i], packed + bound);
+			offsets[i] = bound;
+			bound += sizes[i] + sizes[i] / 8 + 1;
+			sizes[i] = size;
+		}
+		Py_END_ALLOW_THREADS
+	}
+
+	list = PyList_New(count);
+	for (i = 0; list && i < count; ++i) {
+		item = PyBytes_FromStringAndSize((packed ? packed : frames) + offsets[i], sizes[i]);
+		if (NULL == item) {
+			Py_CLEAR(list);
+			break;
+		}
+		PyList_SET_ITEM(list, i, item);
+	}
+
+	RET:
+	PyMem_Free(packed);
+	PyMem_Free(frames);
+	PyMem_Free(sizes);
+	PyMem_Free(offsets);
+	Py_DECREF(seq);
+	return list;
+}
+
+// an iterable of bytes-like frames to a list of (id, dict); with unpack, unpacking runs with the GIL released
+PyObject *
+py_sge_decode_many(PyObject *self, PyObject *args) {
+	int proto_idx, unpack = 0;
+	char *unpacked = NULL;
+	size_t total = 0;
+	Py_ssize_t i, count, views = 0;
+	PyObject *iterable, *seq, *object, *item;
+	PyObject *list = NULL;
+	Py_buffer *view = NULL;
+	const char **frames = NULL;
+	Py_ssize_t *lens = NULL;
+
+	if (!PyArg_ParseTuple(args, "O|p", &iterable, &unpack)) {
+		return NULL;
+	}
+	seq = PySequence_Fast(iterable, "args 1 must be iterable");
+	if (NULL == seq) {
+		return NULL;
+	}
+
+	count = PySequence_Fast_GET_SIZE(seq);
+	view = PyMem_Calloc(count ? count : 1, sizeof(Py_buffer));
+	frames = PyMem_Malloc(sizeof(char *) * (count ? count : 1));
+	lens = PyMem_Malloc(sizeof(Py_ssize_t) * (count ? count : 1));
+	if (NULL == view || NULL == frames || NULL == lens) {
+		PyErr_NoMemory();
+		goto RET;
+	}
+	for (views = 0; views < count; ++views) {
+		if (0 != PyObject_GetBuffer(PySequence_Fast_GET_ITEM(seq, views), &view[views], PyBUF_SIMPLE)) {
+			goto RET;
+		}
+		if (unpack && view[views].len > INT_MAX / 8) {
+			PyErr_Format(PyExc_ValueError, "item %zd is too long", views);
+			PyBuffer_Release(&view[views]);
+			goto RET;
+		}
+		frames[views] = view[views].buf;
+		lens[views] = view[views].len;
+		total += (size_t)view[views].len * 8;
+	}
+
+	if (unpack && count) {
+		// sge_unpack drops trailing zero bytes, every frame gets its zero filled upper bound
+		unpacked = PyMem_Calloc(total ? total : 1, 1);
+		if (NULL == unpacked) {
+			PyErr_NoMemory();
+			goto RET;
+		}
+		Py_BEGIN_ALLOW_THREADS
+		for (i = 0, total = 0; i < count; ++i) {
+			if (lens[i]) {
+				sge_unpack(frames[i], lens[i], unpacked + total);
+			}
+			frames[i] = unpacked + total;
+			total += lens[i] * 8;
+			lens[i] *= 8;
+		}
+		Py_END_ALLOW_THREADS
+	}
+
+	list = PyList_New(count);
+	for (i = 0; list && i < count; ++i) {
+		if (lens[i] < 6) {
+			PyErr_Format(PyExc_RuntimeError, "item %zd: bytes wrong format.", i);
+			Py_CLEAR(list);
+			break;
+		}
+		object = PyDict_New();
+		if (NULL == object) {
+			Py_CLEAR(list);
+			break;
+		}
+		proto_idx = sge_decode_n(frames[i], lens[i], object, py_field_set);
+		if (proto_idx < 0) {
+			Py_DECREF(object);
+			PyErr_Format(PyExc_RuntimeError, "item %zd: %s", i, sge_error(proto_idx));
+			Py_CLEAR(list);
+			break;
+		}
+		item = Py_BuildValue("(iN)", proto_idx, object);
+		if (NULL == item) {
+			Py_CLEAR(list);
+			break;
+		}
+		PyList_SET_ITEM(list, i, item);
+	}
+
+	RET:
+	while (views--) {
+		PyBuffer_Release(&view[views]);
+	}
+	PyMem_Free(unpacked);
+	PyMem_Free(lens);
+	PyMem_Free(frames);
+	PyMem_Free(view);
+	Py_DECREF(seq);
+	return list;
+}
+
 static PyMethodDef sgeProtoMethods[] = {
 	{"parse", py_sge_parse, METH_O, "sg protocol parse from string buffer"},
 	{"parseFile", py_sge_parse_file, METH_O, "sg protocol parse from file"},
 	{"encode", py_sge_encode, METH_VARARGS, "sg protocol encode"},
-	{"decode", py_sge_decode, METH_O, "sg protocol decode"},
+	{"encodeInto", py_sge_encode_into, METH_VARARGS, "encode into a writable buffer at offset, returns the size"},
+	{"decode", (PyCFunction)(void (*)(void))py_sge_decode, METH_VARARGS | METH_KEYWORDS,
+		"sg protocol decode, fields=['Block.field', ...] decodes only those"},
+	{"decodePacked", (PyCFunction)(void (*)(void))py_sge_decode_packed, METH_VARARGS | METH_KEYWORDS, "decode the output of pack without unpacking it first"},
+	{"decodeObject", py_sge_decode_object, METH_VARARGS, "decode into the generated class of the block"},
+	{"classes", py_sge_classes, METH_NOARGS, "the generated __slots__ class of every block, by name"},
+	{"encodeBatch", py_sge_encode_batch, METH_VARARGS, "encode a list of (name, dict) into one container"},
+	{"decodeBatch", py_sge_decode_batch, METH_VARARGS, "decode a container into a list of (id, dict)"},
+	{"encodeMany", py_sge_encode_many, METH_VARARGS, "encode every object of an iterable to its own frame"},
+	{"decodeMany", py_sge_decode_many, METH_VARARGS, "decode an iterable of frames into a list of (id, dict)"},
+	{"setOption", py_sge_set_option, METH_VARARGS, "set an encode option"},
 	{"destory", py_sge_destroy, METH_NOARGS, "destory sg protocol table"},
 	{"debug", py_sge_debug, METH_NOARGS, "debug"},
-	{"pack", py_sge_pack, METH_O, "pack"},
-	{"unpack", py_sge_unpack, METH_O, "unpack"},
+	{"pack", py_sge_pack, METH_VARARGS, "pack"},
+	{"unpack", py_sge_unpack, METH_VARARGS, "unpack"},
+	{"compress", py_sge_compress, METH_VARARGS, "raw, zero packed or LZ, whichever is smallest, flagged in the header"},
+	{"decompress", py_sge_decompress, METH_VARARGS, "the frame behind compress, plain frames come back as they are"},
 	{NULL, NULL, 0, NULL}
 };
 
@@ -273,5 +1164,24 @@ static struct PyModuleDef sgeProtoModule = {
 };
 
 PyMODINIT_FUNC PyInit_sgeProto(void) {
-	return PyModule_Create(&sgeProtoModule);
+	PyObject *module = PyModule_Create(&sgeProtoModule);
+
+	if (module == NULL) {
+		return NULL;
+	}
+	PyModule_AddIntConstant(module, "OPT_INTEGRITY", SGE_OPT_INTEGRITY);
+	PyModule_AddIntConstant(module, "OPT_VERSION", SGE_OPT_VERSION);
+	PyModule_AddIntConstant(module, "INTEGRITY_CRC16", SGE_INTEGRITY_CRC16);
+	PyModule_AddIntConstant(module, "INTEGRITY_NONE", SGE_INTEGRITY_NONE);
+	PyModule_AddIntConstant(module, "INTEGRITY_CRC32C", SGE_INTEGRITY_CRC32C);
+	PyModule_AddIntConstant(module, "VERSION_1", SGE_VERSION_1);
+	PyModule_AddIntConstant(module, "VERSION_2", SGE_VERSION_2);
+	PyModule_AddIntConstant(module, "VERSION_3", SGE_VERSION_3);
+	PyModule_AddIntConstant(module, "OPT_PRESENCE", SGE_OPT_PRESENCE);
+	PyModule_AddIntConstant(module, "OPT_DEFAULTS", SGE_OPT_DEFAULTS);
+	PyModule_AddIntConstant(module, "PRESENCE_NONE", SGE_PRESENCE_NONE);
+	PyModule_AddIntConstant(module, "PRESENCE_BITMAP", SGE_PRESENCE_BITMAP);
+	PyModule_AddIntConstant(module, "DEFAULTS_FILL", SGE_DEFAULTS_FILL);
+	PyModule_AddIntConstant(module, "DEFAULTS_SKIP", SGE_DEFAULTS_SKIP);
+	return module;
 }
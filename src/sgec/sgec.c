@@ -0,0 +1,489 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "sge_proto.h"
+#include "sge_parser.h"
+
+#define MAX_PATH_SIZE 1024
+#define VALID_IDENT(c) ((c >= 65 && c <= 90) || (c >= 48 && c <= 57) || (c == 95))
+
+static const char* SGEC_RUNTIME = "\
+static inline uint8_t*\n\
+sgec_put8(uint8_t* p, uint32_t v) {\n\
+	p[0] = v & 0xff;\n\
+	return p + 1;\n\
+}\n\
+\n\
+static inline uint8_t*\n\
+sgec_put16(uint8_t* p, uint32_t v) {\n\
+	p[0] = (v >> 8) & 0xff;\n\
+	p[1] = v & 0xff;\n\
+	return p + 2;\n\
+}\n\
+\n\
+static inline uint8_t*\n\
+sgec_put32(uint8_t* p, uint32_t v) {\n\
+	p[0] = (v >> 24) & 0xff;\n\
+	p[1] = (v >> 16) & 0xff;\n\
+	p[2] = (v >> 8) & 0xff;\n\
+	p[3] = v & 0xff;\n\
+	return p + 4;\n\
+}\n\
+\n\
+static inline int32_t\n\
+sgec_get8(const uint8_t* p) {\n\
+	return (int8_t)p[0];\n\
+}\n\
+\n\
+static inline int32_t\n\
+sgec_get16(const uint8_t* p) {\n\
+	return (int16_t)((p[0] << 8) | p[1]);\n\
+}\n\
+\n\
+static inline int32_t\n\
+sgec_get32(const uint8_t* p) {\n\
+	return (int32_t)(((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]);\n\
+}\n\
+\n\
+static inline size_t\n\
+sgec_getlen(const uint8_t* p) {\n\
+	return (p[0] << 8) | p[1];\n\
+}\n\
+\n\
+#define SGEC_NEED(p, end, n) if ((size_t)((end) - (p)) < (size_t)(n)) return NULL\n\
+#define SGEC_FIT(n, ret) if ((n) > 0xffff) return ret\n\
+#define SGEC_TOO_LONG ((size_t)-1)\n\
+\n";
+
+static const char*
+number_type(int width) {
+	switch (width) {
+		case 1: return "int8_t";
+		case 2: return "int16_t";
+		default: return "int32_t";
+	}
+}
+
+static int
+block_count(const sge_proto* proto) {
+	int n = 0;
+	sge_list* pb;
+
+	LIST_FOREACH(pb, &proto->block_head) {
+		n++;
+	}
+	return n;
+}
+
+static void
+gen_struct(FILE* fp, const sge_block* block) {
+	uint32_t i;
+	const sge_field_code* code;
+
+	fprintf(fp, "struct %s {\n", block->name);
+	for (i = 0; i < block->size; ++i) {
+		code = block->codes + i;
+		switch (code->opcode) {
+			case SGE_OP_NUMBER:
+				fprintf(fp, "\t%s %s;\n", number_type(code->width), code->name);
+				break;
+			case SGE_OP_NUMBER_LIST:
+				fprintf(fp, "\tstruct {\n\t\t%s* items;\n\t\tsize_t len;\n\t} %s;\n", number_type(code->width), code->name);
+				break;
+			case SGE_OP_STRING:
+				fprintf(fp, "\tsgec_string %s;\n", code->name);
+				break;
+			case SGE_OP_STRING_LIST:
+				fprintf(fp, "\tstruct {\n\t\tsgec_string* items;\n\t\tsize_t len;\n\t} %s;\n", code->name);
+				break;
+			case SGE_OP_CUSTOM:
+				fprintf(fp, "\t%s* %s;\n", code->block->name, code->name);
+				break;
+			case SGE_OP_CUSTOM_LIST:
+				fprintf(fp, "\tstruct {\n\t\t%s* items;\n\t\tsize_t len;\n\t} %s;\n", code->block->name, code->name);
+				break;
+		}
+	}
+	fprintf(fp, "};\n\n");
+}
+
+static void
+gen_size_body(FILE* fp, const sge_block* block) {
+	uint32_t i;
+	const sge_field_code* code;
+
+	fprintf(fp, "static size_t\nsize_body_%s(const %s* in) {\n", block->name, block->name);
+	fprintf(fp, "\tsize_t i, n, size = 0;\n\n\t(void)i;\n\t(void)n;\n");
+	for (i = 0; i < block->size; ++i) {
+		code = block->codes + i;
+		switch (code->opcode) {
+			case SGE_OP_NUMBER:
+				fprintf(fp, "\tsize += %d;\n", code->width);
+				break;
+			case SGE_OP_NUMBER_LIST:
+				fprintf(fp, "\tSGEC_FIT(in->%s.len, SGEC_TOO_LONG);\n", code->name);
+				fprintf(fp, "\tsize += 2 + in->%s.len * %d;\n", code->name, code->width);
+				break;
+			case SGE_OP_STRING:
+				fprintf(fp, "\tSGEC_FIT(in->%s.len, SGEC_TOO_LONG);\n", code->name);
+				fprintf(fp, "\tsize += 2 + in->%s.len;\n", code->name);
+				break;
+			case SGE_OP_STRING_LIST:
+				fprintf(fp, "\tSGEC_FIT(in->%s.len, SGEC_TOO_LONG);\n", code->name);
+				fprintf(fp, "\tsize += 2;\n");
+				fprintf(fp, "\tfor (i = 0; i < in->%s.len; ++i) {\n", code->name);
+				fprintf(fp, "\t\tSGEC_FIT(in->%s.items[i].len, SGEC_TOO_LONG);\n", code->name);
+				fprintf(fp, "\t\tsize += 2 + in->%s.items[i].len;\n\t}\n", code->name);
+				break;
+			case SGE_OP_CUSTOM:
+				fprintf(fp, "\tsize += 1;\n");
+				fprintf(fp, "\tif (in->%s) {\n", code->name);
+				fprintf(fp, "\t\tn = size_body_%s(in->%s);\n", code->block->name, code->name);
+				fprintf(fp, "\t\tif (n == SGEC_TOO_LONG) {\n\t\t\treturn n;\n\t\t}\n");
+				fprintf(fp, "\t\tsize += n;\n\t}\n");
+				break;
+			case SGE_OP_CUSTOM_LIST:
+				fprintf(fp, "\tSGEC_FIT(in->%s.len, SGEC_TOO_LONG);\n", code->name);
+				fprintf(fp, "\tsize += 2;\n");
+				fprintf(fp, "\tfor (i = 0; i < in->%s.len; ++i) {\n", code->name);
+				fprintf(fp, "\t\tn = size_body_%s(in->%s.items + i);\n", code->block->name, code->name);
+				fprintf(fp, "\t\tif (n == SGEC_TOO_LONG) {\n\t\t\treturn n;\n\t\t}\n");
+				fprintf(fp, "\t\tsize += 1 + n;\n\t}\n");
+				break;
+		}
+	}
+	fprintf(fp, "\treturn size;\n}\n\n");
+}
+
+static void
+gen_encode_body(FILE* fp, const sge_block* block) {
+	uint32_t i;
+	const sge_field_code* code;
+
+	fprintf(fp, "static uint8_t*\nenc_body_%s(const %s* in, uint8_t* p) {\n", block->name, block->name);
+	fprintf(fp, "\tsize_t i;\n\n\t(void)i;\n");
+	for (i = 0; i < block->size; ++i) {
+		code = block->codes + i;
+		switch (code->opcode) {
+			case SGE_OP_NUMBER:
+				fprintf(fp, "\tp = sgec_put%d(p, in->%s);\n", code->width * 8, code->name);
+				break;
+			case SGE_OP_NUMBER_LIST:
+				fprintf(fp, "\tSGEC_FIT(in->%s.len, NULL);\n", code->name);
+				fprintf(fp, "\tp = sgec_put16(p, in->%s.len);\n", code->name);
+				fprintf(fp, "\tfor (i = 0; i < in->%s.len; ++i) {\n", code->name);
+				fprintf(fp, "\t\tp = sgec_put%d(p, in->%s.items[i]);\n\t}\n", code->width * 8, code->name);
+				break;
+			case SGE_OP_STRING:
+				fprintf(fp, "\tSGEC_FIT(in->%s.len, NULL);\n", code->name);
+				fprintf(fp, "\tp = sgec_put16(p, in->%s.len);\n", code->name);
+				fprintf(fp, "\tmemcpy(p, in->%s.data, in->%s.len);\n", code->name, code->name);
+				fprintf(fp, "\tp += in->%s.len;\n", code->name);
+				break;
+			case SGE_OP_STRING_LIST:
+				fprintf(fp, "\tSGEC_FIT(in->%s.len, NULL);\n", code->name);
+				fprintf(fp, "\tp = sgec_put16(p, in->%s.len);\n", code->name);
+				fprintf(fp, "\tfor (i = 0; i < in->%s.len; ++i) {\n", code->name);
+				fprintf(fp, "\t\tSGEC_FIT(in->%s.items[i].len, NULL);\n", code->name);
+				fprintf(fp, "\t\tp = sgec_put16(p, in->%s.items[i].len);\n", code->name);
+				fprintf(fp, "\t\tmemcpy(p, in->%s.items[i].data, in->%s.items[i].len);\n", code->name, code->name);
+				fprintf(fp, "\t\tp += in->%s.items[i].len;\n\t}\n", code->name);
+				break;
+			case SGE_OP_CUSTOM:
+				fprintf(fp, "\tif (in->%s) {\n", code->name);
+				fprintf(fp, "\t\tp = sgec_put8(p, 1);\n");
+				fprintf(fp, "\t\tp = enc_body_%s(in->%s, p);\n", code->block->name, code->name);
+				fprintf(fp, "\t\tif (NULL == p) {\n\t\t\treturn NULL;\n\t\t}\n");
+				fprintf(fp, "\t} else {\n\t\tp = sgec_put8(p, 0);\n\t}\n");
+				break;
+			case SGE_OP_CUSTOM_LIST:
+				fprintf(fp, "\tSGEC_FIT(in->%s.len, NULL);\n", code->name);
+				fprintf(fp, "\tp = sgec_put16(p, in->%s.len);\n", code->name);
+				fprintf(fp, "\tfor (i = 0; i < in->%s.len; ++i) {\n", code->name);
+				fprintf(fp, "\t\tp = sgec_put8(p, 1);\n");
+				fprintf(fp, "\t\tp = enc_body_%s(in->%s.items + i, p);\n", code->block->name, code->name);
+				fprintf(fp, "\t\tif (NULL == p) {\n\t\t\treturn NULL;\n\t\t}\n\t}\n");
+				break;
+		}
+	}
+	fprintf(fp, "\treturn p;\n}\n\n");
+}
+
+static void
+gen_decode_body(FILE* fp, const sge_block* block) {
+	uint32_t i;
+	const sge_field_code* code;
+
+	fprintf(fp, "static const uint8_t*\ndec_body_%s(%s* out, const uint8_t* p, const uint8_t* end) {\n", block->name, block->name);
+	fprintf(fp, "\tsize_t i, n;\n\n\t(void)i;\n\t(void)n;\n");
+	for (i = 0; i < block->size; ++i) {
+		code = block->codes + i;
+		switch (code->opcode) {
+			case SGE_OP_NUMBER:
+				fprintf(fp, "\tSGEC_NEED(p, end, %d);\n", code->width);
+				fprintf(fp, "\tout->%s = sgec_get%d(p);\n", code->name, code->width * 8);
+				fprintf(fp, "\tp += %d;\n", code->width);
+				break;
+			case SGE_OP_NUMBER_LIST:
+				fprintf(fp, "\tSGEC_NEED(p, end, 2);\n");
+				fprintf(fp, "\tn = sgec_getlen(p);\n\tp += 2;\n");
+				fprintf(fp, "\tSGEC_NEED(p, end, n * %d);\n", code->width);
+				fprintf(fp, "\tout->%s.items = calloc(n ? n : 1, sizeof(*out->%s.items));\n", code->name, code->name);
+				fprintf(fp, "\tout->%s.len = n;\n", code->name);
+				fprintf(fp, "\tfor (i = 0; i < n; ++i) {\n");
+				fprintf(fp, "\t\tout->%s.items[i] = sgec_get%d(p);\n", code->name, code->width * 8);
+				fprintf(fp, "\t\tp += %d;\n\t}\n", code->width);
+				break;
+			case SGE_OP_STRING:
+				fprintf(fp, "\tSGEC_NEED(p, end, 2);\n");
+				fprintf(fp, "\tn = sgec_getlen(p);\n\tp += 2;\n");
+				fprintf(fp, "\tSGEC_NEED(p, end, n);\n");
+				fprintf(fp, "\tout->%s.data = (const char*)p;\n", code->name);
+				fprintf(fp, "\tout->%s.len = n;\n\tp += n;\n", code->name);
+				break;
+			case SGE_OP_STRING_LIST:
+				fprintf(fp, "\tSGEC_NEED(p, end, 2);\n");
+				fprintf(fp, "\tn = sgec_getlen(p);\n\tp += 2;\n");
+				fprintf(fp, "\tout->%s.items = calloc(n ? n : 1, sizeof(*out->%s.items));\n", code->name, code->name);
+				fprintf(fp, "\tout->%s.len = n;\n", code->name);
+				fprintf(fp, "\tfor (i = 0; i < out->%s.len; ++i) {\n", code->name);
+				fprintf(fp, "\t\tSGEC_NEED(p, end, 2);\n");
+				fprintf(fp, "\t\tn = sgec_getlen(p);\n\t\tp += 2;\n");
+				fprintf(fp, "\t\tSGEC_NEED(p, end, n);\n");
+				fprintf(fp, "\t\tout->%s.items[i].data = (const char*)p;\n", code->name);
+				fprintf(fp, "\t\tout->%s.items[i].len = n;\n\t\tp += n;\n\t}\n", code->name);
+				break;
+			case SGE_OP_CUSTOM:
+				fprintf(fp, "\tSGEC_NEED(p, end, 1);\n");
+				fprintf(fp, "\tif (*p++) {\n");
+				fprintf(fp, "\t\tout->%s = calloc(1, sizeof(%s));\n", code->name, code->block->name);
+				fprintf(fp, "\t\tp = dec_body_%s(out->%s, p, end);\n", code->block->name, code->name);
+				fprintf(fp, "\t\tif (NULL == p) {\n\t\t\treturn NULL;\n\t\t}\n\t}\n");
+				break;
+			case SGE_OP_CUSTOM_LIST:
+				fprintf(fp, "\tSGEC_NEED(p, end, 2);\n");
+				fprintf(fp, "\tn = sgec_getlen(p);\n\tp += 2;\n");
+				fprintf(fp, "\tSGEC_NEED(p, end, n);\n");
+				fprintf(fp, "\tout->%s.items = calloc(n ? n : 1, sizeof(%s));\n", code->name, code->block->name);
+				fprintf(fp, "\tout->%s.len = n;\n", code->name);
+				fprintf(fp, "\tfor (i = 0; i < out->%s.len; ++i) {\n", code->name);
+				fprintf(fp, "\t\tSGEC_NEED(p, end, 1);\n");
+				fprintf(fp, "\t\tif (*p++) {\n");
+				fprintf(fp, "\t\t\tp = dec_body_%s(out->%s.items + i, p, end);\n", code->block->name, code->name);
+				fprintf(fp, "\t\t\tif (NULL == p) {\n\t\t\t\treturn NULL;\n\t\t\t}\n\t\t}\n\t}\n");
+				break;
+		}
+	}
+	fprintf(fp, "\treturn p;\n}\n\n");
+}
+
+static void
+gen_free_body(FILE* fp, const sge_block* block) {
+	uint32_t i;
+	const sge_field_code* code;
+
+	fprintf(fp, "static void\nfree_body_%s(%s* in) {\n", block->name, block->name);
+	fprintf(fp, "\tsize_t i;\n\n\t(void)i;\n");
+	for (i = 0; i < block->size; ++i) {
+		code = block->codes + i;
+		switch (code->opcode) {
+			case SGE_OP_NUMBER_LIST:
+			case SGE_OP_STRING_LIST:
+				fprintf(fp, "\tfree(in->%s.items);\n", code->name);
+				break;
+			case SGE_OP_CUSTOM:
+				fprintf(fp, "\tif (in->%s) {\n", code->name);
+				fprintf(fp, "\t\tfree_body_%s(in->%s);\n", code->block->name, code->name);
+				fprintf(fp, "\t\tfree(in->%s);\n\t}\n", code->name);
+				break;
+			case SGE_OP_CUSTOM_LIST:
+				fprintf(fp, "\tfor (i = 0; in->%s.items && i < in->%s.len; ++i) {\n", code->name, code->name);
+				fprintf(fp, "\t\tfree_body_%s(in->%s.items + i);\n\t}\n", code->block->name, code->name);
+				fprintf(fp, "\tfree(in->%s.items);\n", code->name);
+				break;
+			default:
+				break;
+		}
+	}
+	fprintf(fp, "}\n\n");
+}
+
+static void
+gen_export(FILE* fp, const sge_block* block) {
+	const char* name = block->name;
+
+	// generated code writes "01" frames only, 0 means a string or list doesn't fit a 16 bit length
+	fprintf(fp, "size_t\nencoded_size_%s(const %s* in) {\n", name, name);
+	fprintf(fp, "\tsize_t size = size_body_%s(in);\n\n", name);
+	fprintf(fp, "\treturn size == SGEC_TOO_LONG ? 0 : 6 + size;\n}\n\n");
+
+	fprintf(fp, "size_t\nencode_%s(const %s* in, uint8_t* buffer) {\n", name, name);
+	fprintf(fp, "\tuint8_t* p = buffer + 2;\n\n");
+	fprintf(fp, "\tp = sgec_put8(p, '0');\n\tp = sgec_put8(p, '1');\n");
+	fprintf(fp, "\tp = sgec_put16(p, %s_ID);\n", name);
+	fprintf(fp, "\tp = enc_body_%s(in, p);\n", name);
+	fprintf(fp, "\tif (NULL == p) {\n\t\treturn 0;\n\t}\n");
+	fprintf(fp, "\tsgec_put16(buffer, sge_crc16((const char*)buffer + 2, p - buffer - 2));\n");
+	fprintf(fp, "\treturn p - buffer;\n}\n\n");
+
+	fprintf(fp, "int\ndecode_%s(%s* out, const uint8_t* buffer, size_t len) {\n", name, name);
+	fprintf(fp, "\tconst uint8_t* p;\n\n");
+	fprintf(fp, "\tmemset(out, 0, sizeof(*out));\n");
+	fprintf(fp, "\tif (len < 6 || buffer[2] != '0' || buffer[3] != '1' || sgec_getlen(buffer + 4) != %s_ID) {\n", name);
+	fprintf(fp, "\t\treturn -1;\n\t}\n");
+	fprintf(fp, "\tp = dec_body_%s(out, buffer + 6, buffer + len);\n", name);
+	fprintf(fp, "\tif (NULL == p || sgec_getlen(buffer) != sge_crc16((const char*)buffer + 2, p - buffer - 2)) {\n");
+	fprintf(fp, "\t\tfree_%s(out);\n\t\treturn -1;\n\t}\n", name);
+	fprintf(fp, "\treturn p - buffer;\n}\n\n");
+
+	fprintf(fp, "void\nfree_%s(%s* in) {\n", name, name);
+	fprintf(fp, "\tfree_body_%s(in);\n", name);
+	fprintf(fp, "\tmemset(in, 0, sizeof(*in));\n}\n\n");
+}
+
+static int
+gen_header(const sge_proto* proto, const char* path, const char* base, const char* guard) {
+	sge_list* pb;
+	sge_block* block;
+	FILE* fp = fopen(path, "w");
+
+	if (NULL == fp) {
+		return RES_CANT_ACCESS;
+	}
+
+	fprintf(fp, "// generated by sgec from %s.proto, do not edit\n", base);
+	fprintf(fp, "#ifndef %s\n#define %s\n\n", guard, guard);
+	fprintf(fp, "#include <stddef.h>\n#include <stdint.h>\n\n");
+	fprintf(fp, "#ifndef SGEC_STRING_\n#define SGEC_STRING_\n");
+	fprintf(fp, "typedef struct {\n\tconst char* data;\n\tsize_t len;\n} sgec_string;\n#endif\n\n");
+
+	LIST_FOREACH(pb, &proto->block_head) {
+		block = LIST_DATA(pb, sge_block, head);
+		fprintf(fp, "typedef struct %s %s;\n", block->name, block->name);
+	}
+	fprintf(fp, "\n");
+
+	LIST_FOREACH(pb, &proto->block_head) {
+		block = LIST_DATA(pb, sge_block, head);
+		fprintf(fp, "#define %s_ID %u\n", block->name, block->idx);
+	}
+	fprintf(fp, "\n");
+
+	LIST_FOREACH(pb, &proto->block_head) {
+		block = LIST_DATA(pb, sge_block, head);
+		gen_struct(fp, block);
+	}
+
+	LIST_FOREACH(pb, &proto->block_head) {
+		block = LIST_DATA(pb, sge_block, head);
+		fprintf(fp, "size_t encoded_size_%s(const %s* in);\n", block->name, block->name);
+		fprintf(fp, "size_t encode_%s(const %s* in, uint8_t* buffer);\n", block->name, block->name);
+		fprintf(fp, "int decode_%s(%s* out, const uint8_t* buffer, size_t len);\n", block->name, block->name);
+		fprintf(fp, "void free_%s(%s* in);\n\n", block->name, block->name);
+	}
+
+	fprintf(fp, "#endif\n");
+	fclose(fp);
+	return SGE_OK;
+}
+
+static int
+gen_source(const sge_proto* proto, const char* path, const char* base) {
+	sge_list* pb;
+	sge_block* block;
+	FILE* fp = fopen(path, "w");
+
+	if (NULL == fp) {
+		return RES_CANT_ACCESS;
+	}
+
+	fprintf(fp, "// generated by sgec from %s.proto, do not edit\n", base);
+	fprintf(fp, "#include <stdlib.h>\n#include <string.h>\n\n");
+	fprintf(fp, "#include \"sge_crc16.h\"\n#include \"%s_sge.h\"\n\n", base);
+	fputs(SGEC_RUNTIME, fp);
+
+	LIST_FOREACH(pb, &proto->block_head) {
+		block = LIST_DATA(pb, sge_block, head);
+		fprintf(fp, "static size_t size_body_%s(const %s* in);\n", block->name, block->name);
+		fprintf(fp, "static uint8_t* enc_body_%s(const %s* in, uint8_t* p);\n", block->name, block->name);
+		fprintf(fp, "static const uint8_t* dec_body_%s(%s* out, const uint8_t* p, const uint8_t* end);\n", block->name, block->name);
+		fprintf(fp, "static void free_body_%s(%s* in);\n", block->name, block->name);
+	}
+	fprintf(fp, "\n");
+
+	LIST_FOREACH(pb, &proto->block_head) {
+		block = LIST_DATA(pb, sge_block, head);
+		gen_size_body(fp, block);
+		gen_encode_body(fp, block);
+		gen_decode_body(fp, block);
+		gen_free_body(fp, block);
+		gen_export(fp, block);
+	}
+
+	fclose(fp);
+	return SGE_OK;
+}
+
+static void
+base_name(const char* file, char* base, size_t size) {
+	const char* start = strrchr(file, '/');
+	const char* dot;
+	size_t len;
+
+	start = start ? start + 1 : file;
+	dot = strrchr(start, '.');
+	len = dot ? (size_t)(dot - start) : strlen(start);
+	len = (len >= size) ? size - 1 : len;
+	memcpy(base, start, len);
+	base[len] = '\0';
+}
+
+int main(int argc, char const *argv[]) {
+	int ret, i;
+	const sge_proto* proto;
+	const char* outdir = ".";
+	char base[256], guard[256], path[MAX_PATH_SIZE];
+
+	if (argc != 2 && !(argc == 4 && strcmp(argv[2], "-o") == 0)) {
+		fprintf(stderr, "usage: %s file.proto [-o outdir]\n", argv[0]);
+		return 1;
+	}
+	if (argc == 4) {
+		outdir = argv[3];
+	}
+
+	ret = sge_parse_file(argv[1]);
+	if (ret != SGE_OK) {
+		fprintf(stderr, "sgec: %s\n", sge_error(ret));
+		return 1;
+	}
+
+	proto = sge_get_protocol();
+	if (block_count(proto) == 0) {
+		fprintf(stderr, "sgec: %s has no protocol\n", argv[1]);
+		sge_destroy(1);
+		return 1;
+	}
+
+	base_name(argv[1], base, sizeof(base));
+	for (i = 0; base[i]; ++i) {
+		guard[i] = (base[i] >= 'a' && base[i] <= 'z') ? base[i] - 32 : base[i];
+		if (!VALID_IDENT(guard[i])) {
+			guard[i] = '_';
+		}
+	}
+	snprintf(guard + i, sizeof(guard) - i, "_SGE_H_");
+
+	snprintf(path, sizeof(path), "%s/%s_sge.h", outdir, base);
+	ret = gen_header(proto, path, base, guard);
+	if (ret == SGE_OK) {
+		snprintf(path, sizeof(path), "%s/%s_sge.c", outdir, base);
+		ret = gen_source(proto, path, base);
+	}
+	if (ret != SGE_OK) {
+		fprintf(stderr, "sgec: can't write %s\n", path);
+	}
+
+	sge_destroy(1);
+	return ret == SGE_OK ? 0 : 1;
+}